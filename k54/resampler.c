@@ -1,9 +1,11 @@
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #if (defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__amd64__))
 #include <xmmintrin.h>
+#include <emmintrin.h>
 #define RESAMPLER_SSE
 #endif
 #ifdef __APPLE__
@@ -15,11 +17,26 @@
 #ifdef RESAMPLER_NEON
 #include <arm_neon.h>
 #endif
+#if defined(RESAMPLER_SSE) && ((defined(_MSC_VER) && _MSC_VER >= 1910) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#include <immintrin.h>
+#define RESAMPLER_AVX
+#endif
 
 #ifdef _MSC_VER
 #define ALIGNED     _declspec(align(16))
+#define TARGET(x)
+#define FORCE_INLINE __forceinline
 #else
 #define ALIGNED     __attribute__((aligned(16)))
+#define TARGET(x)   __attribute__((target(x)))
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
 #endif
 
 #ifndef M_PI
@@ -33,19 +50,69 @@ enum { RESAMPLER_SHIFT_EXTRA = 8 };
 enum { RESAMPLER_RESOLUTION = 1 << RESAMPLER_SHIFT };
 enum { RESAMPLER_RESOLUTION_EXTRA = 1 << (RESAMPLER_SHIFT + RESAMPLER_SHIFT_EXTRA) };
 enum { SINC_WIDTH = 32 };
+enum { SINC_MAX_WIDTH = 64 };
 enum { SINC_SAMPLES = RESAMPLER_RESOLUTION * SINC_WIDTH };
+enum { SINC_MAX_SAMPLES = RESAMPLER_RESOLUTION * SINC_MAX_WIDTH };
 enum { CUBIC_SAMPLES = RESAMPLER_RESOLUTION * 4 };
+enum { SINC_PHASE_SHIFT = 8 };
+enum { SINC_PHASES = 1 << SINC_PHASE_SHIFT };
+enum { SINC_BANK_SAMPLES = ( SINC_PHASES + 1 ) * SINC_WIDTH * 2 };
+enum { SINC_WIDTH_COUNT = 4 };
+enum { RESAMPLER_ALIGNMENT = 64 };
+enum { RESAMPLER_RATIONAL_MAX_PHASES = 1024 };
 enum { IIR_ORDER = 6 };
+enum { HALFBAND_TAPS = 23 };
+enum { HALFBAND_TERMS = ( HALFBAND_TAPS + 1 ) / 4 };
+enum { HALFBAND_HISTORY = ( HALFBAND_TAPS - 1 ) / 2 };
+enum { RESAMPLER_DECIMATE_FACTOR = 4 };
+enum { RESAMPLER_DECIMATE_MAX_STAGES = 8 };
+enum { RESAMPLER_DECIMATE_BLOCK = 1 << RESAMPLER_DECIMATE_MAX_STAGES };
+enum { RESAMPLER_RAMP_CHUNK = 16 };
+enum { BLAM_CUTOFF_STEPS = 1024 };
 
+// defaults for the filter design, see resampler_set_filter
 static const float RESAMPLER_BLEP_CUTOFF = 0.90f;
 static const float RESAMPLER_SINC_CUTOFF = 0.999f;
+static const double RESAMPLER_KAISER_BETA = 8.6;
 
-ALIGNED static float cubic_lut[CUBIC_SAMPLES];
+// Catmull-Rom weights for each phase x = i / RESAMPLER_RESOLUTION, spelled
+// out as constant expressions so the table is static data with no startup
+// cost. The arithmetic matches the loop it replaces term for term.
+#define CUBIC_X(i) ((double)(i) / RESAMPLER_RESOLUTION)
+#define CUBIC_ROW(i) \
+    (float)(-0.5 * CUBIC_X(i) * CUBIC_X(i) * CUBIC_X(i) +       CUBIC_X(i) * CUBIC_X(i) - 0.5 * CUBIC_X(i)), \
+    (float)( 1.5 * CUBIC_X(i) * CUBIC_X(i) * CUBIC_X(i) - 2.5 * CUBIC_X(i) * CUBIC_X(i)                    + 1.0), \
+    (float)(-1.5 * CUBIC_X(i) * CUBIC_X(i) * CUBIC_X(i) + 2.0 * CUBIC_X(i) * CUBIC_X(i) + 0.5 * CUBIC_X(i)), \
+    (float)( 0.5 * CUBIC_X(i) * CUBIC_X(i) * CUBIC_X(i) - 0.5 * CUBIC_X(i) * CUBIC_X(i))
+#define CUBIC_ROWS_4(i)    CUBIC_ROW(i),         CUBIC_ROW((i) + 1),        CUBIC_ROW((i) + 2),        CUBIC_ROW((i) + 3)
+#define CUBIC_ROWS_16(i)   CUBIC_ROWS_4(i),      CUBIC_ROWS_4((i) + 4),     CUBIC_ROWS_4((i) + 8),     CUBIC_ROWS_4((i) + 12)
+#define CUBIC_ROWS_64(i)   CUBIC_ROWS_16(i),     CUBIC_ROWS_16((i) + 16),   CUBIC_ROWS_16((i) + 32),   CUBIC_ROWS_16((i) + 48)
+#define CUBIC_ROWS_256(i)  CUBIC_ROWS_64(i),     CUBIC_ROWS_64((i) + 64),   CUBIC_ROWS_64((i) + 128),  CUBIC_ROWS_64((i) + 192)
+#define CUBIC_ROWS_1024(i) CUBIC_ROWS_256(i),    CUBIC_ROWS_256((i) + 256), CUBIC_ROWS_256((i) + 512), CUBIC_ROWS_256((i) + 768)
 
-static float sinc_lut[SINC_SAMPLES + 1];
+// the initializer below spells out exactly 1024 phases
+typedef char resampler_cubic_lut_check[RESAMPLER_RESOLUTION == 1024 ? 1 : -1];
+
+ALIGNED static const float cubic_lut[CUBIC_SAMPLES] = { CUBIC_ROWS_1024(0) };
+
+// sinc_lut reaches the widest kernel; window_lut, the default Nuttall
+// window, is indexed in units of a SINC_WIDTH kernel and gets scaled for
+// the others
+static float sinc_lut[SINC_MAX_SAMPLES + 1];
 static float window_lut[SINC_SAMPLES + 1];
 
+// odd taps 1, 3, 5... of the half-band decimator; the even taps are zero
+// apart from the 0.5 center
+static float halfband_lut[HALFBAND_TERMS];
+
+// tan(M_PI * cutoff) over the BLAM cutoff range 0 to 0.45, and the Q of
+// each Butterworth stage, for retuning the filter without libm calls
+static double blam_prewarp_lut[BLAM_CUTOFF_STEPS + 1];
+static double blam_quality[IIR_ORDER / 2];
+
 enum { resampler_buffer_size = SINC_WIDTH * 4 };
+enum { RESAMPLER_MAX_BUFFER_SIZE = 1 << 24 };
+enum { RESAMPLER_MC_PLANAR_FRAMES = 32 };
 
 static int fEqual(const float b, const float a)
 {
@@ -62,7 +129,7 @@ static float sinc(float x)
 #include <intrin.h>
 #elif defined(__clang__) || defined(__GNUC__)
 static inline void
-__cpuid(int *data, int selector)
+__cpuidex(int *data, int selector, int subleaf)
 {
 #if defined(__PIC__) && defined(__i386__)
     asm("xchgl %%ebx, %%esi; cpuid; xchgl %%ebx, %%esi"
@@ -70,376 +137,1984 @@ __cpuid(int *data, int selector)
         "=S" (data[1]),
         "=c" (data[2]),
         "=d" (data[3])
-        : "0" (selector));
+        : "0" (selector), "2" (subleaf));
 #elif defined(__PIC__) && defined(__amd64__)
     asm("xchg{q} {%%}rbx, %q1; cpuid; xchg{q} {%%}rbx, %q1"
         : "=a" (data[0]),
         "=&r" (data[1]),
         "=c" (data[2]),
         "=d" (data[3])
-        : "0" (selector));
+        : "0" (selector), "2" (subleaf));
 #else
     asm("cpuid"
         : "=a" (data[0]),
         "=b" (data[1]),
         "=c" (data[2]),
         "=d" (data[3])
-        : "0" (selector));
+        : "0" (selector), "2" (subleaf));
 #endif
 }
+#define __cpuid(a,b) __cpuidex((a), (b), 0)
 #else
+#define __cpuidex(a,b,c) memset((a), 0, sizeof(int) * 4)
 #define __cpuid(a,b) memset((a), 0, sizeof(int) * 4)
 #endif
 
-static int query_cpu_feature_sse() {
-    int buffer[4];
+enum
+{
+    RESAMPLER_CPU_SSE = 1,
+    RESAMPLER_CPU_AVX2 = 2,
+    RESAMPLER_CPU_AVX512 = 4,
+    RESAMPLER_CPU_SSE2 = 8
+};
+
+static unsigned long long query_xcr0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#elif defined(__clang__) || defined(__GNUC__)
+    unsigned int eax, edx;
+    asm(".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((unsigned long long)edx << 32) | eax;
+#else
+    return 0;
+#endif
+}
+
+static int query_cpu_features() {
+    int buffer[4], features = 0, max_leaf;
+    unsigned long long xcr0;
+    __cpuid(buffer,0);
+    max_leaf = buffer[0];
     __cpuid(buffer,1);
     if ((buffer[3]&(1<<25)) == 0) return 0;
-    return 1;
+    features |= RESAMPLER_CPU_SSE;
+    if (buffer[3]&(1<<26)) features |= RESAMPLER_CPU_SSE2;
+    // AVX state must be enabled by the OS, and FMA is required alongside AVX2
+    if (max_leaf < 7 || (buffer[2]&(1<<27)) == 0 || (buffer[2]&(1<<28)) == 0 || (buffer[2]&(1<<12)) == 0) return features;
+    xcr0 = query_xcr0();
+    if ((xcr0&0x06) != 0x06) return features;
+    __cpuidex(buffer,7,0);
+    if ((buffer[1]&(1<<5)) == 0) return features;
+    features |= RESAMPLER_CPU_AVX2;
+    if ((buffer[1]&(1<<16)) == 0 || (xcr0&0xE6) != 0xE6) return features;
+    features |= RESAMPLER_CPU_AVX512;
+    return features;
 }
 
-static int resampler_has_sse = 0;
+static int resampler_cpu_features = 0;
 #endif
 
-void resampler_init(void)
+static void resampler_select_kernels(void);
+static double butterworth(unsigned int order, unsigned int phase);
+
+// zeroth order modified Bessel function of the first kind, by its series
+static double bessel_i0(double x)
 {
-    unsigned i;
-    double dx = (float)(SINC_WIDTH) / SINC_SAMPLES, x = 0.0;
-    for (i = 0; i < SINC_SAMPLES + 1; ++i, x += dx)
+    double sum = 1.0, term = 1.0;
+    int k;
+    for (k = 1; k < 64 && term > sum * 1.0e-12; ++k)
     {
-        float y = x / SINC_WIDTH;
-#if 0
-        // Blackman
-        float window = 0.42659 - 0.49656 * cos(M_PI + M_PI * y) + 0.076849 * cos(2.0 * M_PI * y);
-#elif 1
-        // Nuttal 3 term
-        float window = 0.40897 + 0.5 * cos(M_PI * y) + 0.09103 * cos(2.0 * M_PI * y);
-#elif 0
-        // C.R.Helmrich's 2 term window
-        float window = 0.79445 * cos(0.5 * M_PI * y) + 0.20555 * cos(1.5 * M_PI * y);
-#elif 0
-        // Lanczos
-        float window = sinc(y);
-#endif
-        sinc_lut[i] = fabs(x) < SINC_WIDTH ? sinc(x) : 0.0;
-        window_lut[i] = window;
+        term *= ( x / ( 2 * k ) ) * ( x / ( 2 * k ) );
+        sum += term;
     }
-    dx = 1.0 / (float)(RESAMPLER_RESOLUTION);
-    x = 0.0;
-    for (i = 0; i < RESAMPLER_RESOLUTION; ++i, x += dx)
+    return sum;
+}
+
+// y is the distance from the kernel center in units of the kernel width
+static float resampler_window(int window, double beta, float y)
+{
+    switch (window)
     {
-        cubic_lut[i*4]   = (float)(-0.5 * x * x * x +       x * x - 0.5 * x);
-        cubic_lut[i*4+1] = (float)( 1.5 * x * x * x - 2.5 * x * x           + 1.0);
-        cubic_lut[i*4+2] = (float)(-1.5 * x * x * x + 2.0 * x * x + 0.5 * x);
-        cubic_lut[i*4+3] = (float)( 0.5 * x * x * x - 0.5 * x * x);
+    case RESAMPLER_WINDOW_BLACKMAN:
+        return 0.42659 - 0.49656 * cos(M_PI + M_PI * y) + 0.076849 * cos(2.0 * M_PI * y);
+    case RESAMPLER_WINDOW_HELMRICH:
+        // C.R.Helmrich's 2 term window
+        return 0.79445 * cos(0.5 * M_PI * y) + 0.20555 * cos(1.5 * M_PI * y);
+    case RESAMPLER_WINDOW_LANCZOS:
+        return sinc(y);
+    case RESAMPLER_WINDOW_KAISER:
+        {
+            double t = 1.0 - (double)y * y;
+            return bessel_i0(beta * sqrt(t > 0.0 ? t : 0.0)) / bessel_i0(beta);
+        }
+    default:
+        // Nuttal 3 term
+        return 0.40897 + 0.5 * cos(M_PI * y) + 0.09103 * cos(2.0 * M_PI * y);
     }
-#ifdef RESAMPLER_SSE
-    resampler_has_sse = query_cpu_feature_sse();
-#endif
 }
 
-typedef struct iir
+// Kaiser's estimate of the beta for the stopband attenuation a kernel of
+// width taps per side reaches over the transition width, as a fraction of
+// the Nyquist frequency
+static double resampler_kaiser_beta(double transition, int width)
 {
-    double cutoff;              //frequency cutoff
-    double quality;             //frequency response quality
-    double gain;                //peak gain
-    double a0, a1, a2, b1, b2;  //coefficients
-    double z1, z2;              //second-order IIR
-} iir;
+    double atten = 2.285 * ( width * 2 - 1 ) * M_PI * transition + 7.95;
+    if ( atten > 50.0 )
+        return 0.1102 * ( atten - 8.7 );
+    if ( atten > 21.0 )
+        return 0.5842 * pow( atten - 21.0, 0.4 ) + 0.07886 * ( atten - 21.0 );
+    return 0.0;
+}
 
-inline static void iir_reset(iir * i, double cutoff, double quality, double gain)
+// The beta a window table is built with: only Kaiser has one, given
+// directly or derived from the transition width
+static double resampler_window_beta(int window, double beta, double transition, int width)
 {
-    double v, k, q, n;
+    if ( window != RESAMPLER_WINDOW_KAISER )
+        return 0.0;
+    if ( beta > 0.0 )
+        return beta;
+    if ( transition > 0.0 )
+        return resampler_kaiser_beta( transition, width );
+    return RESAMPLER_KAISER_BETA;
+}
 
-    i->cutoff = cutoff;
-    i->quality = quality;
-    i->gain = gain;
+static void resampler_build_window(float * table, int window, double beta)
+{
+    unsigned i;
+    double dx = (float)(SINC_WIDTH) / SINC_SAMPLES, x = 0.0;
+    for (i = 0; i < SINC_SAMPLES + 1; ++i, x += dx)
+        table[i] = resampler_window(window, beta, x / SINC_WIDTH);
+}
+
+static void resampler_init_once(void)
+{
+    unsigned i;
+    double dx = (float)(SINC_WIDTH) / SINC_SAMPLES, x = 0.0;
+    for (i = 0; i < SINC_SAMPLES + 1; ++i, x += dx)
+        sinc_lut[i] = fabs(x) < SINC_WIDTH ? sinc(x) : 0.0;
+    for (; i < SINC_MAX_SAMPLES + 1; ++i, x += dx)
+        sinc_lut[i] = fabs(x) < SINC_MAX_WIDTH ? sinc(x) : 0.0;
+    resampler_build_window(window_lut, RESAMPLER_WINDOW_NUTTALL, 0.0);
+    {
+        double terms[HALFBAND_TERMS], sum = 0.0;
+        for (i = 0; i < HALFBAND_TERMS; ++i)
+        {
+            x = i * 2 + 1;
+            terms[i] = sinc(x * 0.5) * resampler_window(RESAMPLER_WINDOW_NUTTALL, 0.0, x / ( HALFBAND_TAPS / 2 + 1 ));
+            sum += terms[i];
+        }
+        // normalize for unity gain at DC: 0.5 + 2 * sum = 1
+        for (i = 0; i < HALFBAND_TERMS; ++i)
+            halfband_lut[i] = (float)(terms[i] * 0.25 / sum);
+    }
+    for (i = 0; i < BLAM_CUTOFF_STEPS + 1; ++i)
+        blam_prewarp_lut[i] = tan(M_PI * 0.45 * i / BLAM_CUTOFF_STEPS);
+    for (i = 0; i < IIR_ORDER / 2; ++i)
+        blam_quality[i] = butterworth(IIR_ORDER, i);
+#ifdef RESAMPLER_SSE
+    resampler_cpu_features = query_cpu_features();
+#endif
+    resampler_select_kernels();
+}
 
-    v = pow(10, fabs(gain) / 20.0);
-    k = tan(M_PI * cutoff);
-    q = quality;
+// The tables and kernel selection are built exactly once per process, by
+// whichever thread gets here first; the others wait for it to finish.
+#ifdef _WIN32
+static INIT_ONCE resampler_once = INIT_ONCE_STATIC_INIT;
 
-    n = 1 / (1 + k / q + k * k);
-    i->a0 = k * k * n;
-    i->a1 = 2 * i->a0;
-    i->a2 = i->a0;
-    i->b1 = 2 * (k * k - 1) * n;
-    i->b2 = (1 - k / q + k * k) * n;
+static BOOL CALLBACK resampler_init_callback(PINIT_ONCE once, PVOID param, PVOID * context)
+{
+    resampler_init_once();
+    return TRUE;
 }
 
-inline static void iir_clear(iir * i)
+void resampler_init(void)
 {
-    i->z1 = 0.0;
-    i->z2 = 0.0;
+    InitOnceExecuteOnce( &resampler_once, resampler_init_callback, NULL, NULL );
 }
+#else
+static pthread_once_t resampler_once = PTHREAD_ONCE_INIT;
 
-inline static double iir_process(iir * i, double in)
+void resampler_init(void)
 {
-    double out = in * i->a0 + i->z1;
-    i->z1 = in * i->a1 + i->z2 - i->b1 * out;
-    i->z2 = in * i->a2 - i->b2 * out;
-    return out;
+    pthread_once( &resampler_once, resampler_init_once );
 }
+#endif
 
-static double butterworth(unsigned int order, unsigned int phase)
+static void * resampler_aligned_malloc(size_t size)
 {
-  return -0.5 / cos(M_PI / 2.0 * (1.0 + (1.0 + (2.0 * phase + 1.0) / order)));
+    unsigned char * block = ( unsigned char * ) malloc( size + RESAMPLER_ALIGNMENT - 1 + sizeof(void *) );
+    unsigned char * aligned;
+    if ( !block ) return 0;
+    aligned = block + sizeof(void *);
+    aligned += ( RESAMPLER_ALIGNMENT - ( (size_t)aligned & ( RESAMPLER_ALIGNMENT - 1 ) ) ) & ( RESAMPLER_ALIGNMENT - 1 );
+    ((void **)aligned)[-1] = block;
+    return aligned;
 }
 
-typedef struct resampler
+static void resampler_aligned_free(void * ptr)
 {
-    int write_pos, write_filled;
-    int read_pos, read_filled;
-    float phase;
-    float phase_inc;
-    float inv_phase;
-    float inv_phase_inc;
-    unsigned char quality;
-    signed char delay_added;
-    signed char delay_removed;
-    unsigned char output_stage;
-    float last_amp;
-    float accumulator;
-    float buffer_in[resampler_buffer_size * 2];
-    float buffer_out[resampler_buffer_size + SINC_WIDTH * 2 - 1];
-    iir filter[IIR_ORDER / 2];
-} resampler;
+    if ( ptr ) free( ((void **)ptr)[-1] );
+}
 
-void * resampler_create(void)
+// Window tables and sinc banks are shared between all instances with the
+// same filter design. Each is built on first use and freed with its last
+// reference; a sinc bank holds a reference to the window table it was
+// built from. The default window is window_lut and is never freed.
+typedef struct resampler_table
 {
-    resampler * r = ( resampler * ) malloc( sizeof(resampler) );
-    if ( !r ) return 0;
+    struct resampler_table * next;
+    int refs;
+    int window;
+    double beta;
+    // sinc banks only
+    struct resampler_table * source;
+    int width, step;
+    float * data;
+} resampler_table;
 
-    r->write_pos = SINC_WIDTH - 1;
-    r->write_filled = 0;
-    r->read_pos = 0;
-    r->read_filled = 0;
-    r->phase = 0;
-    r->phase_inc = 0;
-    r->inv_phase = 0;
-    r->inv_phase_inc = 0;
-    r->quality = RESAMPLER_QUALITY_MAX;
-    r->delay_added = -1;
-    r->delay_removed = -1;
-    r->output_stage = 0;
-    r->last_amp = 0;
-    r->accumulator = 0;
-    memset( r->buffer_in, 0, sizeof(r->buffer_in) );
-    memset( r->buffer_out, 0, sizeof(r->buffer_out) );
-    memset( r->filter, 0, sizeof(r->filter) );
+static resampler_table resampler_default_window = { 0, 1, RESAMPLER_WINDOW_NUTTALL, 0.0, 0, 0, 0, window_lut };
+static resampler_table * resampler_window_tables = &resampler_default_window;
+static resampler_table * resampler_sinc_tables = 0;
 
-    return r;
-}
+#ifdef _WIN32
+static SRWLOCK resampler_tables_lock = SRWLOCK_INIT;
 
-void resampler_delete(void * _r)
+static void resampler_lock_tables(void)
 {
-    free( _r );
+    AcquireSRWLockExclusive( &resampler_tables_lock );
 }
 
-void * resampler_dup(const void * _r)
+static void resampler_unlock_tables(void)
 {
-    void * r_out = malloc( sizeof(resampler) );
-    if ( !r_out ) return 0;
-
-    resampler_dup_inplace(r_out, _r);
-
-    return r_out;
+    ReleaseSRWLockExclusive( &resampler_tables_lock );
 }
+#else
+static pthread_mutex_t resampler_tables_lock = PTHREAD_MUTEX_INITIALIZER;
 
-void resampler_dup_inplace(void *_d, const void *_s)
+static void resampler_lock_tables(void)
 {
-    const resampler * r_in = ( const resampler * ) _s;
-    resampler * r_out = ( resampler * ) _d;
+    pthread_mutex_lock( &resampler_tables_lock );
+}
 
-    r_out->write_pos = r_in->write_pos;
-    r_out->write_filled = r_in->write_filled;
-    r_out->read_pos = r_in->read_pos;
-    r_out->read_filled = r_in->read_filled;
-    r_out->phase = r_in->phase;
-    r_out->phase_inc = r_in->phase_inc;
-    r_out->inv_phase = r_in->inv_phase;
-    r_out->inv_phase_inc = r_in->inv_phase_inc;
-    r_out->quality = r_in->quality;
-    r_out->delay_added = r_in->delay_added;
-    r_out->delay_removed = r_in->delay_removed;
-    r_out->output_stage = r_in->output_stage;
-    r_out->last_amp = r_in->last_amp;
-    r_out->accumulator = r_in->accumulator;
-    memcpy( r_out->buffer_in, r_in->buffer_in, sizeof(r_in->buffer_in) );
-    memcpy( r_out->buffer_out, r_in->buffer_out, sizeof(r_in->buffer_out) );
-    memcpy( r_out->filter, r_in->filter, sizeof(r_in->filter) );
+static void resampler_unlock_tables(void)
+{
+    pthread_mutex_unlock( &resampler_tables_lock );
 }
+#endif
 
-void resampler_set_quality(void *_r, int quality)
+static resampler_table * resampler_retain_table(resampler_table * t)
 {
-    resampler * r = ( resampler * ) _r;
-    if (quality < RESAMPLER_QUALITY_MIN)
-        quality = RESAMPLER_QUALITY_MIN;
-    else if (quality > RESAMPLER_QUALITY_MAX)
-        quality = RESAMPLER_QUALITY_MAX;
-    if ( r->quality != quality )
-    {
-        if ( quality == RESAMPLER_QUALITY_BLEP || r->quality == RESAMPLER_QUALITY_BLEP )
-        {
-            r->read_pos = 0;
-            r->read_filled = 0;
-            r->last_amp = 0;
-            r->accumulator = 0;
-            memset( r->buffer_out, 0, sizeof(r->buffer_out) );
-        }
-        r->delay_added = -1;
-        r->delay_removed = -1;
-        if ( quality == RESAMPLER_QUALITY_BLAM && r->phase_inc )
-            resampler_set_rate( r, r->phase_inc );
-    }
-    r->quality = (unsigned char)quality;
+    resampler_lock_tables();
+    ++t->refs;
+    resampler_unlock_tables();
+    return t;
 }
 
-int resampler_get_free_count(void *_r)
+static void resampler_release_table_locked(resampler_table * t)
 {
-    resampler * r = ( resampler * ) _r;
-    return resampler_buffer_size - r->write_filled;
+    resampler_table ** link;
+    if ( --t->refs )
+        return;
+    link = t->source ? &resampler_sinc_tables : &resampler_window_tables;
+    while ( *link != t )
+        link = &(*link)->next;
+    *link = t->next;
+    if ( t->source )
+        resampler_release_table_locked( t->source );
+    resampler_aligned_free( t->data );
+    free( t );
 }
 
-static int resampler_min_filled(resampler *r)
+static void resampler_release_table(resampler_table * t)
 {
-    switch (r->quality)
-    {
-    default:
-    case RESAMPLER_QUALITY_ZOH:
-    case RESAMPLER_QUALITY_BLEP:
-        return 1;
-            
-    case RESAMPLER_QUALITY_LINEAR:
-    case RESAMPLER_QUALITY_BLAM:
-        return 2;
-            
-    case RESAMPLER_QUALITY_CUBIC:
-        return 4;
-            
-    case RESAMPLER_QUALITY_SINC:
-        return SINC_WIDTH * 2;
-    }
+    if ( !t ) return;
+    resampler_lock_tables();
+    resampler_release_table_locked( t );
+    resampler_unlock_tables();
 }
 
-static int resampler_input_delay(resampler *r)
+static resampler_table * resampler_new_table(size_t samples)
 {
-    switch (r->quality)
+    resampler_table * t = ( resampler_table * ) malloc( sizeof(resampler_table) );
+    if ( !t ) return 0;
+    t->data = ( float * ) resampler_aligned_malloc( samples * sizeof(float) );
+    if ( !t->data )
     {
-    default:
-    case RESAMPLER_QUALITY_ZOH:
-    case RESAMPLER_QUALITY_BLEP:
-    case RESAMPLER_QUALITY_LINEAR:
-    case RESAMPLER_QUALITY_BLAM:
+        free( t );
         return 0;
-            
-    case RESAMPLER_QUALITY_CUBIC:
-        return 1;
-            
-    case RESAMPLER_QUALITY_SINC:
-        return SINC_WIDTH - 1;
     }
+    t->refs = 1;
+    t->source = 0;
+    t->width = 0;
+    t->step = 0;
+    return t;
 }
 
-static int resampler_output_delay(resampler *r)
+static resampler_table * resampler_acquire_window(int window, double beta)
 {
-    switch (r->quality)
+    resampler_table * t;
+    resampler_lock_tables();
+    for ( t = resampler_window_tables; t; t = t->next )
+        if ( t->window == window && t->beta == beta )
+            break;
+    if ( t )
+        ++t->refs;
+    else if ( ( t = resampler_new_table( SINC_SAMPLES + 1 ) ) )
     {
-    default:
-    case RESAMPLER_QUALITY_ZOH:
-    case RESAMPLER_QUALITY_LINEAR:
-    case RESAMPLER_QUALITY_BLAM:
-    case RESAMPLER_QUALITY_CUBIC:
-    case RESAMPLER_QUALITY_SINC:
-        return 0;
-            
-    case RESAMPLER_QUALITY_BLEP:
-        return SINC_WIDTH - 1;
+        t->window = window;
+        t->beta = beta;
+        resampler_build_window( t->data, window, beta );
+        t->next = resampler_window_tables;
+        resampler_window_tables = t;
     }
+    resampler_unlock_tables();
+    return t;
 }
 
-int resampler_get_padding_size()
+static int resampler_sinc_step(double phase_inc, float cutoff)
 {
-    return SINC_WIDTH - 1;
+    return phase_inc > 1.0 ? (int)(RESAMPLER_RESOLUTION / phase_inc * cutoff) : (int)(RESAMPLER_RESOLUTION * cutoff);
 }
 
-int resampler_ready(void *_r)
+// Supported widths are SINC_WIDTH_MIN << index, up to SINC_MAX_WIDTH
+enum { SINC_WIDTH_MIN = SINC_MAX_WIDTH >> ( SINC_WIDTH_COUNT - 1 ) };
+
+static int resampler_sinc_width_index(int width)
 {
-    resampler * r = ( resampler * ) _r;
-    return r->write_filled > resampler_min_filled(r);
+    int index = 0;
+    while ( ( SINC_WIDTH_MIN << index ) < width )
+        ++index;
+    return index;
 }
 
-void resampler_clear(void *_r)
+static size_t resampler_sinc_bank_samples(int width)
 {
-    resampler * r = ( resampler * ) _r;
-    r->write_pos = SINC_WIDTH - 1;
-    r->write_filled = 0;
-    r->read_pos = 0;
-    r->read_filled = 0;
-    r->phase = 0;
-    r->delay_added = -1;
-    r->delay_removed = -1;
-    memset(r->buffer_in, 0, (SINC_WIDTH - 1) * sizeof(r->buffer_in[0]));
-    memset(r->buffer_in + resampler_buffer_size, 0, (SINC_WIDTH - 1) * sizeof(r->buffer_in[0]));
-    if (r->quality == RESAMPLER_QUALITY_BLEP)
-    {
-        r->inv_phase = 0;
-        r->last_amp = 0;
-        r->accumulator = 0;
-        memset(r->buffer_out, 0, sizeof(r->buffer_out));
-    }
-    if (r->quality == RESAMPLER_QUALITY_BLAM)
-    {
-        unsigned int i, j;
-        for (i = 0, j = IIR_ORDER / 2; i < j; ++i)
-            iir_clear(r->filter + i);
-    }
+    return (size_t)( SINC_PHASES + 1 ) * width * 2;
 }
 
-void resampler_set_rate(void *_r, double new_factor)
+// Polyphase bank: SINC_PHASES + 1 normalized kernels of width * 2 taps, one
+// row per phase step from 0.0 to 1.0 inclusive, so the kernels can
+// interpolate between adjacent rows without wrapping.
+static void resampler_build_sinc_bank(float * bank, int step, int width, float const* window)
 {
-    resampler * r = ( resampler * ) _r;
-    float old_phase_inc = r->phase_inc;
-    r->phase_inc = new_factor;
-    new_factor = 1.0 / new_factor;
-    r->inv_phase_inc = new_factor;
-    if (r->quality == RESAMPLER_QUALITY_BLAM && old_phase_inc != r->phase_inc)
+    const int window_step = RESAMPLER_RESOLUTION;
+    int phase;
+
+    for (phase = 0; phase <= SINC_PHASES; ++phase)
     {
-        double ratio_ = new_factor;
-        unsigned int i, j;
-        r->output_stage = (ratio_ >= 1.0);
-        if (!r->output_stage)
-        {
-            ratio_ *= 0.45;
-        }
-        else
-        {
-            ratio_ = (1.0 / ratio_) * 0.45;
-        }
-        if (ratio_ > 0.45)
+        float * kernel = bank + phase * width * 2;
+        int phase_reduced = phase * ( RESAMPLER_RESOLUTION / SINC_PHASES );
+        int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
+        float kernel_sum = 0.0f;
+        int i = width;
+
+        // both window offsets are multiples of 4, so the scaling is exact
+        for (; i >= -width + 1; --i)
         {
-            ratio_ = 0.45;
+            int pos = i * step;
+            int window_pos = i * window_step;
+            kernel_sum += kernel[i + width - 1] = sinc_lut[abs(phase_adj - pos)] * window[abs(phase_reduced - window_pos) * SINC_WIDTH / width];
         }
-        for (i = 0, j = IIR_ORDER / 2; i < j; ++i)
-            iir_reset(r->filter + i, ratio_, butterworth(IIR_ORDER, i), 0.0);
+        kernel_sum = 1.0f / kernel_sum;
+        for (i = 0; i < width * 2; ++i)
+            kernel[i] *= kernel_sum;
     }
 }
 
-void resampler_write_sample(void *_r, short s)
+static resampler_table * resampler_acquire_sinc(resampler_table * window, int width, int step)
 {
-    resampler * r = ( resampler * ) _r;
-
-    if ( r->delay_added < 0 )
+    resampler_table * t;
+    resampler_lock_tables();
+    for ( t = resampler_sinc_tables; t; t = t->next )
+        if ( t->source == window && t->width == width && t->step == step )
+            break;
+    if ( t )
+        ++t->refs;
+    else if ( ( t = resampler_new_table( resampler_sinc_bank_samples( width ) ) ) )
     {
-        r->delay_added = 0;
-        r->write_filled = resampler_input_delay( r );
+        t->window = window->window;
+        t->beta = window->beta;
+        t->source = window;
+        t->width = width;
+        t->step = step;
+        ++window->refs;
+        resampler_build_sinc_bank( t->data, step, width, window->data );
+        t->next = resampler_sinc_tables;
+        resampler_sinc_tables = t;
     }
-    
-    if ( r->write_filled < resampler_buffer_size )
-    {
-        double s32 = s;
-        s32 *= 256.0;
-        s32 += 1e-25;
+    resampler_unlock_tables();
+    return t;
+}
+
+// Phase accumulators are 0.32 fixed point fractions. A step is a 32.32
+// fixed point increment plus an optional remainder, in units of 1/den of
+// the least significant bit, so that rational ratios advance exactly.
+typedef struct resampler_step
+{
+    unsigned long long inc;
+    unsigned int err_inc;
+    unsigned int den;
+} resampler_step;
+
+#define PHASE_TO_FLOAT(x) ((float)(x) * (1.0f / 4294967296.0f))
+
+static void resampler_step_set(resampler_step * s, double factor)
+{
+    s->inc = (unsigned long long)(factor * 4294967296.0 + 0.5);
+    s->err_inc = 0;
+    s->den = 1;
+}
+
+// Factors whose step and inverse step both fit 32.32 fixed point. This
+// leaves out 0, negative and infinite factors and NaN.
+static int resampler_factor_valid(double factor)
+{
+    return factor > 1.0 / 4294967296.0 && factor < 4294967296.0;
+}
+
+static void resampler_step_set_rational(resampler_step * s, unsigned int num, unsigned int den)
+{
+    unsigned long long rem = (unsigned long long)(num % den) << 32;
+    s->inc = ((unsigned long long)(num / den) << 32) + rem / den;
+    s->err_inc = (unsigned int)(rem % den);
+    s->den = den;
+}
+
+static inline int resampler_step_advance(const resampler_step * s, unsigned int * phase, unsigned int * err)
+{
+    unsigned long long pos = (unsigned long long)*phase + s->inc;
+    *err += s->err_inc;
+    if ( *err >= s->den )
+    {
+        *err -= s->den;
+        ++pos;
+    }
+    *phase = (unsigned int)pos;
+    return (int)(pos >> 32);
+}
+
+static unsigned int resampler_gcd(unsigned int a, unsigned int b)
+{
+    while ( b )
+    {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Exact kernels for a rational ratio num / den: the phase only ever takes
+// the den values index / den, so each gets its own precomputed kernel row
+// and the fast path just cycles through them without interpolating.
+typedef struct resampler_rational
+{
+    unsigned int num, den;
+    int quality;
+    int width;
+    const resampler_table * window;
+    float cutoff;
+    float * bank;
+} resampler_rational;
+
+static int resampler_rational_taps(int quality, int width)
+{
+    return quality == RESAMPLER_QUALITY_CUBIC ? 4 : width * 2;
+}
+
+static void resampler_build_rational_bank(float * bank, int quality, int width, unsigned int num, unsigned int den, const resampler_table * window, float sinc_cutoff)
+{
+    const int taps = resampler_rational_taps(quality, width);
+    const double cutoff = (double)resampler_sinc_step((double)num / den, sinc_cutoff) / RESAMPLER_RESOLUTION;
+    unsigned int index;
+
+    for (index = 0; index < den; ++index)
+    {
+        float * kernel = bank + index * taps;
+        double x = (double)index / den;
+        if ( quality == RESAMPLER_QUALITY_CUBIC )
+        {
+            kernel[0] = (float)(-0.5 * x * x * x +       x * x - 0.5 * x);
+            kernel[1] = (float)( 1.5 * x * x * x - 2.5 * x * x           + 1.0);
+            kernel[2] = (float)(-1.5 * x * x * x + 2.0 * x * x + 0.5 * x);
+            kernel[3] = (float)( 0.5 * x * x * x - 0.5 * x * x);
+        }
+        else
+        {
+            double kernel_sum = 0.0;
+            int i;
+            for (i = 0; i < taps; ++i)
+            {
+                double d = x - ( i - ( width - 1 ) );
+                double y = d * cutoff * M_PI;
+                double value = fabs(y) < 1.0e-9 ? 1.0 : sin(y) / y;
+                value *= resampler_window(window->window, window->beta, (float)(fabs(d) / width));
+                kernel[i] = (float)value;
+                kernel_sum += value;
+            }
+            for (i = 0; i < taps; ++i)
+                kernel[i] = (float)(kernel[i] / kernel_sum);
+        }
+    }
+}
+
+static void resampler_rational_free(resampler_rational * rat)
+{
+    resampler_aligned_free( rat->bank );
+    rat->bank = 0;
+}
+
+// Builds the exact bank for quality when the ratio allows it, otherwise
+// drops it and leaves the engine on the generic phase path.
+static void resampler_rational_update(resampler_rational * rat, int quality, int width, const resampler_table * window, float cutoff)
+{
+    if ( ( quality != RESAMPLER_QUALITY_CUBIC && quality != RESAMPLER_QUALITY_SINC ) ||
+         !rat->den || rat->den > RESAMPLER_RATIONAL_MAX_PHASES )
+    {
+        resampler_rational_free( rat );
+        return;
+    }
+    if ( rat->bank && rat->quality == quality && rat->width == width &&
+         rat->window == window && rat->cutoff == cutoff )
+        return;
+    resampler_rational_free( rat );
+    rat->bank = ( float * ) resampler_aligned_malloc( rat->den * resampler_rational_taps( quality, width ) * sizeof(float) );
+    if ( !rat->bank ) return;
+    resampler_build_rational_bank( rat->bank, quality, width, rat->num, rat->den, window, cutoff );
+    rat->quality = quality;
+    rat->width = width;
+    rat->window = window;
+    rat->cutoff = cutoff;
+}
+
+static void resampler_rational_copy(resampler_rational * out, const resampler_rational * in)
+{
+    size_t size = in->bank ? in->den * resampler_rational_taps( in->quality, in->width ) * sizeof(float) : 0;
+    resampler_rational_free( out );
+    out->num = in->num;
+    out->den = in->den;
+    out->quality = in->quality;
+    out->width = in->width;
+    out->window = in->window;
+    out->cutoff = in->cutoff;
+    if ( size && ( out->bank = ( float * ) resampler_aligned_malloc( size ) ) )
+        memcpy( out->bank, in->bank, size );
+}
+
+// Moves the phase down onto a multiple of 1 / den so the remainder
+// stepping and the bank index describe the same position.
+static void resampler_rational_snap(unsigned int den, unsigned int * phase, unsigned int * phase_err)
+{
+    unsigned long long index = ( (unsigned long long)*phase * den ) >> 32;
+    *phase = (unsigned int)( ( index << 32 ) / den );
+    *phase_err = (unsigned int)( ( index << 32 ) % den );
+}
+
+static inline unsigned int resampler_rational_index(unsigned int den, unsigned int phase, unsigned int phase_err)
+{
+    return (unsigned int)( ( (unsigned long long)phase * den + phase_err ) >> 32 );
+}
+
+typedef struct iir
+{
+    double cutoff;              //frequency cutoff
+    double quality;             //frequency response quality
+    double gain;                //peak gain
+    double a0, a1, a2, b1, b2;  //coefficients
+    double z1, z2;              //second-order IIR
+} iir;
+
+// k is the prewarped cutoff, tan(M_PI * cutoff)
+inline static void iir_set_prewarped(iir * i, double k, double q)
+{
+    double n = 1 / (1 + k / q + k * k);
+    i->a0 = k * k * n;
+    i->a1 = 2 * i->a0;
+    i->a2 = i->a0;
+    i->b1 = 2 * (k * k - 1) * n;
+    i->b2 = (1 - k / q + k * k) * n;
+}
+
+inline static void iir_reset(iir * i, double cutoff, double quality, double gain)
+{
+    i->cutoff = cutoff;
+    i->quality = quality;
+    i->gain = gain;
+    iir_set_prewarped(i, tan(M_PI * cutoff), quality);
+}
+
+inline static void iir_clear(iir * i)
+{
+    i->z1 = 0.0;
+    i->z2 = 0.0;
+}
+
+inline static double iir_process(iir * i, double in)
+{
+    double out = in * i->a0 + i->z1;
+    i->z1 = in * i->a1 + i->z2 - i->b1 * out;
+    i->z2 = in * i->a2 - i->b2 * out;
+    return out;
+}
+
+// Block form of the cascade: runs count frames, stride samples apart, of
+// `channels` samples in place, each channel through its own IIR_ORDER / 2
+// stages.
+// The stages are copied to locals so state and coefficients stay in
+// registers for the whole block; results match iir_process exactly.
+static void iir_process_frames(iir * filter, float * data, int count, int stride, int channels)
+{
+    int c, i;
+    for (c = 0; c < channels; ++c)
+    {
+        iir stage[IIR_ORDER / 2];
+        float * s = data + c;
+        memcpy( stage, filter + c * ( IIR_ORDER / 2 ), sizeof(stage) );
+        for (i = 0; i < count; ++i, s += stride)
+        {
+            unsigned int j;
+            double s32 = *s;
+            for (j = 0; j < IIR_ORDER / 2; ++j)
+                s32 = iir_process(stage + j, s32);
+            *s = s32;
+        }
+        memcpy( filter + c * ( IIR_ORDER / 2 ), stage, sizeof(stage) );
+    }
+}
+
+#ifdef RESAMPLER_SSE
+// Two channels per __m128d lane pair. No FMA, so the rounding is the same
+// as the scalar cascade.
+TARGET("sse2")
+static void iir_process_frames_sse2(iir * filter, float * data, int count, int stride, int channels)
+{
+    int c = 0, i, j;
+    for (; c + 2 <= channels; c += 2)
+    {
+        const iir * f0 = filter + c * ( IIR_ORDER / 2 );
+        const iir * f1 = f0 + IIR_ORDER / 2;
+        __m128d a0[IIR_ORDER / 2], a1[IIR_ORDER / 2], a2[IIR_ORDER / 2], b1[IIR_ORDER / 2], b2[IIR_ORDER / 2];
+        __m128d z1[IIR_ORDER / 2], z2[IIR_ORDER / 2];
+        float * s = data + c;
+        for (j = 0; j < IIR_ORDER / 2; ++j)
+        {
+            a0[j] = _mm_set_pd( f1[j].a0, f0[j].a0 );
+            a1[j] = _mm_set_pd( f1[j].a1, f0[j].a1 );
+            a2[j] = _mm_set_pd( f1[j].a2, f0[j].a2 );
+            b1[j] = _mm_set_pd( f1[j].b1, f0[j].b1 );
+            b2[j] = _mm_set_pd( f1[j].b2, f0[j].b2 );
+            z1[j] = _mm_set_pd( f1[j].z1, f0[j].z1 );
+            z2[j] = _mm_set_pd( f1[j].z2, f0[j].z2 );
+        }
+        for (i = 0; i < count; ++i, s += stride)
+        {
+            __m128d in = _mm_cvtps_pd( _mm_castsi128_ps( _mm_loadl_epi64( (const __m128i *) s ) ) );
+            for (j = 0; j < IIR_ORDER / 2; ++j)
+            {
+                __m128d out = _mm_add_pd( _mm_mul_pd( in, a0[j] ), z1[j] );
+                z1[j] = _mm_sub_pd( _mm_add_pd( _mm_mul_pd( in, a1[j] ), z2[j] ), _mm_mul_pd( b1[j], out ) );
+                z2[j] = _mm_sub_pd( _mm_mul_pd( in, a2[j] ), _mm_mul_pd( b2[j], out ) );
+                in = out;
+            }
+            _mm_storel_epi64( (__m128i *) s, _mm_castps_si128( _mm_cvtpd_ps( in ) ) );
+        }
+        for (j = 0; j < IIR_ORDER / 2; ++j)
+        {
+            iir * g0 = filter + c * ( IIR_ORDER / 2 ) + j;
+            iir * g1 = g0 + IIR_ORDER / 2;
+            _mm_storel_pd( &g0->z1, z1[j] );
+            _mm_storeh_pd( &g1->z1, z1[j] );
+            _mm_storel_pd( &g0->z2, z2[j] );
+            _mm_storeh_pd( &g1->z2, z2[j] );
+        }
+    }
+    if ( c < channels )
+        iir_process_frames( filter + c * ( IIR_ORDER / 2 ), data + c, count, stride, channels - c );
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+// Four channels per __m256d, again without FMA.
+TARGET("avx2")
+static void iir_process_frames_avx2(iir * filter, float * data, int count, int stride, int channels)
+{
+    int c = 0, i, j;
+    for (; c + 4 <= channels; c += 4)
+    {
+        const iir * f = filter + c * ( IIR_ORDER / 2 );
+        const int n = IIR_ORDER / 2;
+        __m256d a0[IIR_ORDER / 2], a1[IIR_ORDER / 2], a2[IIR_ORDER / 2], b1[IIR_ORDER / 2], b2[IIR_ORDER / 2];
+        __m256d z1[IIR_ORDER / 2], z2[IIR_ORDER / 2];
+        float * s = data + c;
+        for (j = 0; j < n; ++j)
+        {
+            a0[j] = _mm256_set_pd( f[3 * n + j].a0, f[2 * n + j].a0, f[n + j].a0, f[j].a0 );
+            a1[j] = _mm256_set_pd( f[3 * n + j].a1, f[2 * n + j].a1, f[n + j].a1, f[j].a1 );
+            a2[j] = _mm256_set_pd( f[3 * n + j].a2, f[2 * n + j].a2, f[n + j].a2, f[j].a2 );
+            b1[j] = _mm256_set_pd( f[3 * n + j].b1, f[2 * n + j].b1, f[n + j].b1, f[j].b1 );
+            b2[j] = _mm256_set_pd( f[3 * n + j].b2, f[2 * n + j].b2, f[n + j].b2, f[j].b2 );
+            z1[j] = _mm256_set_pd( f[3 * n + j].z1, f[2 * n + j].z1, f[n + j].z1, f[j].z1 );
+            z2[j] = _mm256_set_pd( f[3 * n + j].z2, f[2 * n + j].z2, f[n + j].z2, f[j].z2 );
+        }
+        for (i = 0; i < count; ++i, s += stride)
+        {
+            __m256d in = _mm256_cvtps_pd( _mm_loadu_ps( s ) );
+            for (j = 0; j < n; ++j)
+            {
+                __m256d out = _mm256_add_pd( _mm256_mul_pd( in, a0[j] ), z1[j] );
+                z1[j] = _mm256_sub_pd( _mm256_add_pd( _mm256_mul_pd( in, a1[j] ), z2[j] ), _mm256_mul_pd( b1[j], out ) );
+                z2[j] = _mm256_sub_pd( _mm256_mul_pd( in, a2[j] ), _mm256_mul_pd( b2[j], out ) );
+                in = out;
+            }
+            _mm_storeu_ps( s, _mm256_cvtpd_ps( in ) );
+        }
+        for (j = 0; j < n; ++j)
+        {
+            ALIGNED double t1[4], t2[4];
+            int k;
+            _mm256_storeu_pd( t1, z1[j] );
+            _mm256_storeu_pd( t2, z2[j] );
+            for (k = 0; k < 4; ++k)
+            {
+                filter[(c + k) * n + j].z1 = t1[k];
+                filter[(c + k) * n + j].z2 = t2[k];
+            }
+        }
+    }
+    if ( c < channels )
+        iir_process_frames_sse2( filter + c * ( IIR_ORDER / 2 ), data + c, count, stride, channels - c );
+}
+#endif
+
+typedef void (*resampler_iir_kernel)(iir *, float *, int, int, int);
+
+static resampler_iir_kernel resampler_iir_frames = iir_process_frames;
+
+// Large downsampling factors first go through a cascade of 2:1 half-band
+// decimators, so the fractional stage only ever sees a factor below
+// RESAMPLER_DECIMATE_FACTOR and its kernel stays a proper lowpass instead of
+// a window stretched over many input samples. With the remaining factor of
+// at least two, everything from 3/8 of each stage's rate up folds outside
+// the final passband, so a short half-band filter is enough.
+//
+// Each stage drops its first few outputs, so output n of a stage is
+// centered on its input 2n and the decimated stream keeps the timing of the
+// input. Input is queued until a whole output sample's worth has arrived;
+// a stage holds back an odd sample until its partner comes in.
+typedef struct resampler_decimator_stage
+{
+    float even[HALFBAND_HISTORY];
+    float odd[HALFBAND_HISTORY];
+    float held;
+    int held_count;
+    int warmup;
+} resampler_decimator_stage;
+
+typedef struct resampler_decimator
+{
+    int stages;
+    int pending;
+    float input[RESAMPLER_DECIMATE_BLOCK];
+    resampler_decimator_stage stage[RESAMPLER_DECIMATE_MAX_STAGES];
+} resampler_decimator;
+
+static int resampler_decimate_stages(int quality, double factor, unsigned int den)
+{
+    int stages = 0;
+    if ( quality != RESAMPLER_QUALITY_BLAM && quality != RESAMPLER_QUALITY_CUBIC &&
+         quality != RESAMPLER_QUALITY_SINC )
+        return 0;
+    // a rational factor stays exact, so the scaled denominator has to fit
+    while ( stages < RESAMPLER_DECIMATE_MAX_STAGES &&
+            factor >= RESAMPLER_DECIMATE_FACTOR &&
+            den <= ( UINT_MAX >> ( stages + 1 ) ) )
+    {
+        factor *= 0.5;
+        ++stages;
+    }
+    return stages;
+}
+
+static void resampler_decimate_reset(resampler_decimator * d, int stages)
+{
+    int i;
+    d->stages = stages;
+    d->pending = 0;
+    memset( d->stage, 0, sizeof(d->stage) );
+    for (i = 0; i < RESAMPLER_DECIMATE_MAX_STAGES; ++i)
+        d->stage[i].warmup = HALFBAND_HISTORY - HALFBAND_TERMS;
+}
+
+// The decimator state is allocated only while there are stages to run, so
+// instances that never decimate stay small. Returns the stages in effect:
+// without memory for the state, the instance goes without decimation.
+static int resampler_set_decimator(resampler_decimator ** d, int stages)
+{
+    if ( !stages )
+    {
+        resampler_aligned_free( *d );
+        *d = 0;
+        return 0;
+    }
+    if ( !*d && !( *d = ( resampler_decimator * ) resampler_aligned_malloc( sizeof(resampler_decimator) ) ) )
+        return 0;
+    resampler_decimate_reset( *d, stages );
+    return stages;
+}
+
+static int resampler_decimator_stages(const resampler_decimator * d)
+{
+    return d ? d->stages : 0;
+}
+
+// out[i] is the half-band output centered on even[i + HALFBAND_TERMS]; the
+// stage input is split into even and odd samples so the taps line up
+// across consecutive outputs.
+static void resampler_halfband(float * out, const float * even, const float * odd, int count)
+{
+    int i, j;
+    for (i = 0; i < count; ++i)
+    {
+        float sum = 0.5f * even[i + HALFBAND_TERMS];
+        for (j = 0; j < HALFBAND_TERMS; ++j)
+            sum += halfband_lut[j] * ( odd[i + HALFBAND_TERMS - 1 - j] + odd[i + HALFBAND_TERMS + j] );
+        out[i] = sum;
+    }
+}
+
+// The vector forms compute the same sums in the same order without FMA,
+// so every path produces identical output.
+#ifdef RESAMPLER_SSE
+static void resampler_halfband_sse(float * out, const float * even, const float * odd, int count)
+{
+    __m128 taps[HALFBAND_TERMS];
+    const __m128 center = _mm_set1_ps( 0.5f );
+    int i = 0, j;
+    for (j = 0; j < HALFBAND_TERMS; ++j)
+        taps[j] = _mm_set1_ps( halfband_lut[j] );
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_mul_ps( center, _mm_loadu_ps( even + i + HALFBAND_TERMS ) );
+        for (j = 0; j < HALFBAND_TERMS; ++j)
+            sum = _mm_add_ps( sum, _mm_mul_ps( taps[j], _mm_add_ps( _mm_loadu_ps( odd + i + HALFBAND_TERMS - 1 - j ), _mm_loadu_ps( odd + i + HALFBAND_TERMS + j ) ) ) );
+        _mm_storeu_ps( out + i, sum );
+    }
+    resampler_halfband( out + i, even + i, odd + i, count - i );
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+TARGET("avx2")
+static void resampler_halfband_avx2(float * out, const float * even, const float * odd, int count)
+{
+    __m256 taps[HALFBAND_TERMS];
+    const __m256 center = _mm256_set1_ps( 0.5f );
+    int i = 0, j;
+    for (j = 0; j < HALFBAND_TERMS; ++j)
+        taps[j] = _mm256_set1_ps( halfband_lut[j] );
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sum = _mm256_mul_ps( center, _mm256_loadu_ps( even + i + HALFBAND_TERMS ) );
+        for (j = 0; j < HALFBAND_TERMS; ++j)
+            sum = _mm256_add_ps( sum, _mm256_mul_ps( taps[j], _mm256_add_ps( _mm256_loadu_ps( odd + i + HALFBAND_TERMS - 1 - j ), _mm256_loadu_ps( odd + i + HALFBAND_TERMS + j ) ) ) );
+        _mm256_storeu_ps( out + i, sum );
+    }
+    // the tail stays in this function: a tail call into the SSE form would
+    // skip the vzeroupper and stall every legacy SSE instruction after it
+    for (; i < count; ++i)
+    {
+        float sum = 0.5f * even[i + HALFBAND_TERMS];
+        for (j = 0; j < HALFBAND_TERMS; ++j)
+            sum += halfband_lut[j] * ( odd[i + HALFBAND_TERMS - 1 - j] + odd[i + HALFBAND_TERMS + j] );
+        out[i] = sum;
+    }
+}
+#endif
+
+#ifdef RESAMPLER_NEON
+static void resampler_halfband_neon(float * out, const float * even, const float * odd, int count)
+{
+    float32x4_t taps[HALFBAND_TERMS];
+    const float32x4_t center = vdupq_n_f32( 0.5f );
+    int i = 0, j;
+    for (j = 0; j < HALFBAND_TERMS; ++j)
+        taps[j] = vdupq_n_f32( halfband_lut[j] );
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t sum = vmulq_f32( center, vld1q_f32( even + i + HALFBAND_TERMS ) );
+        for (j = 0; j < HALFBAND_TERMS; ++j)
+            sum = vaddq_f32( sum, vmulq_f32( taps[j], vaddq_f32( vld1q_f32( odd + i + HALFBAND_TERMS - 1 - j ), vld1q_f32( odd + i + HALFBAND_TERMS + j ) ) ) );
+        vst1q_f32( out + i, sum );
+    }
+    resampler_halfband( out + i, even + i, odd + i, count - i );
+}
+#endif
+
+typedef void (*resampler_halfband_kernel)(float *, const float *, const float *, int);
+
+#ifdef RESAMPLER_NEON
+static resampler_halfband_kernel resampler_halfband_frames = resampler_halfband_neon;
+#else
+static resampler_halfband_kernel resampler_halfband_frames = resampler_halfband;
+#endif
+
+// Runs count inputs, at most RESAMPLER_DECIMATE_BLOCK, through the whole
+// cascade and returns the number of samples stored to out.
+static int resampler_decimate_block(resampler_decimator * d, const float * in, int count, float * out)
+{
+    ALIGNED float even[HALFBAND_HISTORY + RESAMPLER_DECIMATE_BLOCK / 2];
+    ALIGNED float odd[HALFBAND_HISTORY + RESAMPLER_DECIMATE_BLOCK / 2];
+    ALIGNED float buf[RESAMPLER_DECIMATE_BLOCK / 2];
+    int stage;
+
+    // history is kept split, so only the new input needs splitting; each
+    // stage's output becomes the next stage's input
+    for (stage = 0; stage < d->stages; ++stage)
+    {
+        resampler_decimator_stage * st = d->stage + stage;
+        float * stage_out = stage + 1 < d->stages ? buf : out;
+        int i = 0, held = st->held_count, half = ( count + held ) >> 1, drop;
+
+        memcpy( even, st->even, HALFBAND_HISTORY * sizeof(float) );
+        memcpy( odd, st->odd, HALFBAND_HISTORY * sizeof(float) );
+        if ( held && half )
+        {
+            even[HALFBAND_HISTORY] = st->held;
+            odd[HALFBAND_HISTORY] = in[0];
+            i = 1;
+        }
+        for (; i < half; ++i)
+        {
+            even[HALFBAND_HISTORY + i] = in[i * 2 - held];
+            odd[HALFBAND_HISTORY + i] = in[i * 2 + 1 - held];
+        }
+        if ( ( count + held ) & 1 )
+        {
+            if ( count )
+                st->held = in[count - 1];
+            st->held_count = 1;
+        }
+        else
+            st->held_count = 0;
+        memcpy( st->even, even + half, HALFBAND_HISTORY * sizeof(float) );
+        memcpy( st->odd, odd + half, HALFBAND_HISTORY * sizeof(float) );
+
+        resampler_halfband_frames( stage_out, even, odd, half );
+
+        drop = st->warmup < half ? st->warmup : half;
+        if ( drop )
+        {
+            st->warmup -= drop;
+            half -= drop;
+            memmove( stage_out, stage_out + drop, half * sizeof(float) );
+        }
+
+        in = stage_out;
+        count = half;
+    }
+
+    return count;
+}
+
+// Queues one input sample and runs the queue once it holds 1 << stages
+// samples, returning 1 with the decimated sample in out if one came out.
+static int resampler_decimate_sample(resampler_decimator * d, float in, float * out)
+{
+    d->input[d->pending++] = in;
+    if ( d->pending < ( 1 << d->stages ) )
+        return 0;
+    d->pending = 0;
+    return resampler_decimate_block( d, d->input, 1 << d->stages, out );
+}
+
+static double butterworth(unsigned int order, unsigned int phase)
+{
+  return -0.5 / cos(M_PI / 2.0 * (1.0 + (1.0 + (2.0 * phase + 1.0) / order)));
+}
+
+// ratio_ is the output/input rate ratio, the inverse of the resampling factor
+static unsigned char resampler_setup_blam(iir * filter, int count, double ratio_)
+{
+    unsigned char output_stage = (ratio_ >= 1.0);
+    unsigned int i, j;
+    int c;
+    if (!output_stage)
+    {
+        ratio_ *= 0.45;
+    }
+    else
+    {
+        ratio_ = (1.0 / ratio_) * 0.45;
+    }
+    if (ratio_ > 0.45)
+    {
+        ratio_ = 0.45;
+    }
+    for (c = 0; c < count; ++c)
+        for (i = 0, j = IIR_ORDER / 2; i < j; ++i)
+            iir_reset(filter + c * j + i, ratio_, butterworth(IIR_ORDER, i), 0.0);
+    return output_stage;
+}
+
+// Cheap form of resampler_setup_blam for ramps: the prewarp comes from
+// blam_prewarp_lut and the filter state carries over.
+static unsigned char resampler_retune_blam(iir * filter, int count, double ratio_)
+{
+    unsigned char output_stage = (ratio_ >= 1.0);
+    double pos, k;
+    unsigned int i, j;
+    int c, index;
+    ratio_ = ( output_stage ? 1.0 / ratio_ : ratio_ ) * 0.45;
+    if (ratio_ > 0.45)
+        ratio_ = 0.45;
+    pos = ratio_ * ( BLAM_CUTOFF_STEPS / 0.45 );
+    index = (int)pos;
+    if (index > BLAM_CUTOFF_STEPS - 1)
+        index = BLAM_CUTOFF_STEPS - 1;
+    k = blam_prewarp_lut[index] + ( blam_prewarp_lut[index + 1] - blam_prewarp_lut[index] ) * ( pos - index );
+    for (c = 0; c < count; ++c)
+        for (i = 0, j = IIR_ORDER / 2; i < j; ++i)
+        {
+            filter[c * j + i].cutoff = ratio_;
+            filter[c * j + i].quality = blam_quality[i];
+            iir_set_prewarped(filter + c * j + i, k, blam_quality[i]);
+        }
+    return output_stage;
+}
+
+typedef struct resampler
+{
+    int write_pos, write_filled;
+    int read_pos, read_filled;
+    unsigned int phase, phase_err;
+    unsigned int inv_phase, inv_phase_err;
+    // rate is the factor as requested, phase_inc what the ring runs at
+    // after decimation; rate_den is nonzero for a rational rate_num / rate_den
+    double rate;
+    unsigned int rate_num, rate_den;
+    double phase_inc;
+    resampler_step step;
+    resampler_step inv_step;
+    unsigned char quality;
+    signed char delay_added;
+    signed char delay_removed;
+    unsigned char output_stage;
+    float last_amp;
+    float accumulator;
+    int buffer_size;
+    float * buffer_in;
+    float * buffer_out;
+    iir filter[IIR_ORDER / 2];
+    int sinc_width;
+    float * sinc_bank;
+    // filter design; the window table and sinc bank come from the shared
+    // cache and may be in use by other instances
+    int window_type;
+    double kaiser_beta, transition_width;
+    float sinc_cutoff, blep_cutoff;
+    resampler_table * window_table;
+    resampler_table * sinc_table;
+    resampler_rational rational;
+    // 0 unless the rate needs decimating
+    resampler_decimator * decimator;
+    // an active ramp runs the ring from ramp_start to ramp_end over
+    // ramp_frames outputs, of which ramp_pos are done
+    double ramp_start, ramp_end;
+    int ramp_pos, ramp_frames;
+    // the pool a pooled instance goes back to on delete, or 0
+    struct resampler_pool * pool;
+} resampler;
+
+// A fixed set of instances created up front. The free list has room for
+// all of them, so acquire and delete only move pointers.
+typedef struct resampler_pool
+{
+    int count, free_count;
+    resampler ** free_list;
+} resampler_pool;
+
+static int resampler_update_sinc_bank(resampler * r)
+{
+    int step = resampler_sinc_step( r->phase_inc, r->sinc_cutoff );
+    resampler_table * table = r->sinc_table;
+    if ( !table || table->source != r->window_table || table->width != r->sinc_width || table->step != step )
+    {
+        table = resampler_acquire_sinc( r->window_table, r->sinc_width, step );
+        if ( !table ) return 0;
+        resampler_release_table( r->sinc_table );
+        r->sinc_table = table;
+        r->sinc_bank = table->data;
+    }
+    return 1;
+}
+
+static void resampler_free_sinc_bank(resampler * r)
+{
+    resampler_release_table( r->sinc_table );
+    r->sinc_table = 0;
+    r->sinc_bank = 0;
+}
+
+static int resampler_update_window(resampler * r)
+{
+    double beta = resampler_window_beta( r->window_type, r->kaiser_beta, r->transition_width, r->sinc_width );
+    resampler_table * table = r->window_table;
+    if ( table && table->window == r->window_type && table->beta == beta )
+        return 1;
+    table = resampler_acquire_window( r->window_type, beta );
+    if ( !table ) return 0;
+    resampler_release_table( r->window_table );
+    r->window_table = table;
+    return 1;
+}
+
+// Both rings share one allocation: the mirrored input ring, then the
+// output ring with room for the BLEP overlap-add tail.
+static size_t resampler_buffers_samples(int buffer_size)
+{
+    return (size_t)buffer_size * 3 + SINC_WIDTH * 2 - 1;
+}
+
+static int resampler_alloc_buffers(resampler * r, int buffer_size)
+{
+    float * buffers = ( float * ) resampler_aligned_malloc( resampler_buffers_samples( buffer_size ) * sizeof(float) );
+    if ( !buffers ) return 0;
+    resampler_aligned_free( r->buffer_in );
+    r->buffer_size = buffer_size;
+    r->buffer_in = buffers;
+    r->buffer_out = buffers + buffer_size * 2;
+    return 1;
+}
+
+void * resampler_create(void)
+{
+    return resampler_create_ex( resampler_buffer_size );
+}
+
+// Everything but the rings and banks, as a freshly created instance has
+// it. A sinc bank of another width is dropped; one of the default width is
+// kept. The default window is always cached.
+static void resampler_reset(resampler * r)
+{
+    r->write_pos = SINC_MAX_WIDTH - 1;
+    r->write_filled = 0;
+    r->read_pos = 0;
+    r->read_filled = 0;
+    r->phase = 0;
+    r->phase_err = 0;
+    r->inv_phase = 0;
+    r->inv_phase_err = 0;
+    r->rate = 0;
+    r->rate_num = 0;
+    r->rate_den = 0;
+    r->phase_inc = 0;
+    resampler_step_set( &r->step, 0 );
+    resampler_step_set( &r->inv_step, 0 );
+    r->quality = RESAMPLER_QUALITY_MAX;
+    r->delay_added = -1;
+    r->delay_removed = -1;
+    r->output_stage = 0;
+    r->last_amp = 0;
+    r->accumulator = 0;
+    memset( r->buffer_in, 0, resampler_buffers_samples( r->buffer_size ) * sizeof(float) );
+    memset( r->filter, 0, sizeof(r->filter) );
+    if ( r->sinc_width != SINC_WIDTH )
+        resampler_free_sinc_bank( r );
+    r->sinc_width = SINC_WIDTH;
+    r->window_type = RESAMPLER_WINDOW_NUTTALL;
+    r->kaiser_beta = 0;
+    r->transition_width = 0;
+    r->sinc_cutoff = RESAMPLER_SINC_CUTOFF;
+    r->blep_cutoff = RESAMPLER_BLEP_CUTOFF;
+    resampler_update_window( r );
+    resampler_rational_free( &r->rational );
+    r->rational.num = 0;
+    r->rational.den = 0;
+    r->rational.quality = -1;
+    r->rational.width = 0;
+    resampler_set_decimator( &r->decimator, 0 );
+    r->ramp_start = 0;
+    r->ramp_end = 0;
+    r->ramp_pos = 0;
+    r->ramp_frames = 0;
+}
+
+// Clears the whole stream an instance is running and keeps its settings,
+// with the tables, banks and decimator built for them. A ramp in progress
+// stops at the factor it has reached. Neither allocates nor locks, so a
+// pooled instance can be handed out on the audio thread.
+static void resampler_reset_stream(resampler * r)
+{
+    int i;
+    r->write_pos = SINC_MAX_WIDTH - 1;
+    r->write_filled = 0;
+    r->read_pos = 0;
+    r->read_filled = 0;
+    r->phase = 0;
+    r->phase_err = 0;
+    r->inv_phase = 0;
+    r->inv_phase_err = 0;
+    r->delay_added = -1;
+    r->delay_removed = -1;
+    r->last_amp = 0;
+    r->accumulator = 0;
+    memset( r->buffer_in, 0, resampler_buffers_samples( r->buffer_size ) * sizeof(float) );
+    for ( i = 0; i < IIR_ORDER / 2; ++i )
+        iir_clear( r->filter + i );
+    if ( r->decimator )
+        resampler_decimate_reset( r->decimator, r->decimator->stages );
+    if ( r->ramp_frames )
+    {
+        r->rate = r->phase_inc * ( 1 << resampler_decimator_stages( r->decimator ) );
+        r->ramp_pos = 0;
+        r->ramp_frames = 0;
+    }
+}
+
+// Instances are cache line aligned like their rings, so the hot members at
+// the top of the struct never straddle two lines.
+static resampler * resampler_alloc_instance(int buffer_size)
+{
+    resampler * r = ( resampler * ) resampler_aligned_malloc( sizeof(resampler) );
+    if ( !r ) return 0;
+    r->buffer_in = 0;
+    if ( !resampler_alloc_buffers( r, buffer_size ) )
+    {
+        resampler_aligned_free( r );
+        return 0;
+    }
+    r->pool = 0;
+    r->sinc_width = SINC_WIDTH;
+    r->sinc_bank = 0;
+    r->window_table = 0;
+    r->sinc_table = 0;
+    r->rational.bank = 0;
+    r->decimator = 0;
+    return r;
+}
+
+static void resampler_free_instance(resampler * r)
+{
+    resampler_free_sinc_bank( r );
+    resampler_release_table( r->window_table );
+    resampler_rational_free( &r->rational );
+    resampler_aligned_free( r->decimator );
+    resampler_aligned_free( r->buffer_in );
+    resampler_aligned_free( r );
+}
+
+void * resampler_create_ex(size_t buffer_frames)
+{
+    resampler * r;
+    resampler_init();
+
+    if ( buffer_frames < resampler_buffer_size )
+        buffer_frames = resampler_buffer_size;
+    else if ( buffer_frames > RESAMPLER_MAX_BUFFER_SIZE )
+        buffer_frames = RESAMPLER_MAX_BUFFER_SIZE;
+
+    r = resampler_alloc_instance( (int)buffer_frames );
+    if ( !r ) return 0;
+
+    resampler_reset( r );
+
+    if ( !resampler_update_sinc_bank( r ) )
+    {
+        resampler_free_instance( r );
+        return 0;
+    }
+
+    return r;
+}
+
+void resampler_delete(void * _r)
+{
+    resampler * r = ( resampler * ) _r;
+    if ( !r ) return;
+    if ( r->pool )
+    {
+        resampler_pool * pool = r->pool;
+        pool->free_list[pool->free_count++] = r;
+        return;
+    }
+    resampler_free_instance( r );
+}
+
+void * resampler_dup(const void * _r)
+{
+    resampler * r_out = resampler_alloc_instance( (( const resampler * ) _r)->buffer_size );
+    if ( !r_out ) return 0;
+
+    // a copy that cannot decimate like the source is no copy
+    if ( (( const resampler * ) _r)->decimator &&
+         !resampler_set_decimator( &r_out->decimator, (( const resampler * ) _r)->decimator->stages ) )
+    {
+        resampler_free_instance( r_out );
+        return 0;
+    }
+
+    resampler_dup_inplace(r_out, _r);
+
+    if ( r_out->quality != (( const resampler * ) _r)->quality )
+    {
+        resampler_delete( r_out );
+        return 0;
+    }
+
+    return r_out;
+}
+
+void * resampler_pool_create(int count, size_t buffer_frames)
+{
+    resampler_pool * pool;
+    int i;
+
+    if ( count < 1 ) return 0;
+
+    pool = ( resampler_pool * ) malloc( sizeof(resampler_pool) );
+    if ( !pool ) return 0;
+    pool->count = 0;
+    pool->free_count = 0;
+    pool->free_list = ( resampler ** ) malloc( count * sizeof(resampler *) );
+    if ( !pool->free_list )
+    {
+        free( pool );
+        return 0;
+    }
+
+    for ( i = 0; i < count; ++i )
+    {
+        resampler * r = ( resampler * ) resampler_create_ex( buffer_frames );
+        if ( !r )
+        {
+            resampler_pool_delete( pool );
+            return 0;
+        }
+        r->pool = pool;
+        pool->free_list[pool->free_count++] = r;
+        ++pool->count;
+    }
+
+    return pool;
+}
+
+void resampler_pool_delete(void * _pool)
+{
+    resampler_pool * pool = ( resampler_pool * ) _pool;
+    int i;
+    if ( !pool ) return;
+    for ( i = 0; i < pool->free_count; ++i )
+        resampler_free_instance( pool->free_list[i] );
+    free( pool->free_list );
+    free( pool );
+}
+
+void * resampler_pool_acquire(void * _pool)
+{
+    resampler_pool * pool = ( resampler_pool * ) _pool;
+    resampler * r;
+    if ( !pool->free_count ) return 0;
+    r = pool->free_list[--pool->free_count];
+    resampler_reset_stream( r );
+    return r;
+}
+
+void resampler_dup_inplace(void *_d, const void *_s)
+{
+    const resampler * r_in = ( const resampler * ) _s;
+    resampler * r_out = ( resampler * ) _d;
+
+    if ( r_out->buffer_size != r_in->buffer_size &&
+         !resampler_alloc_buffers( r_out, r_in->buffer_size ) )
+        return;
+    if ( r_in->decimator &&
+         !resampler_set_decimator( &r_out->decimator, r_in->decimator->stages ) )
+        return;
+
+    r_out->write_pos = r_in->write_pos;
+    r_out->write_filled = r_in->write_filled;
+    r_out->read_pos = r_in->read_pos;
+    r_out->read_filled = r_in->read_filled;
+    r_out->phase = r_in->phase;
+    r_out->phase_err = r_in->phase_err;
+    r_out->inv_phase = r_in->inv_phase;
+    r_out->inv_phase_err = r_in->inv_phase_err;
+    r_out->rate = r_in->rate;
+    r_out->rate_num = r_in->rate_num;
+    r_out->rate_den = r_in->rate_den;
+    r_out->phase_inc = r_in->phase_inc;
+    r_out->step = r_in->step;
+    r_out->inv_step = r_in->inv_step;
+    r_out->quality = r_in->quality;
+    r_out->delay_added = r_in->delay_added;
+    r_out->delay_removed = r_in->delay_removed;
+    r_out->output_stage = r_in->output_stage;
+    r_out->last_amp = r_in->last_amp;
+    r_out->accumulator = r_in->accumulator;
+    memcpy( r_out->buffer_in, r_in->buffer_in, resampler_buffers_samples( r_in->buffer_size ) * sizeof(float) );
+    memcpy( r_out->filter, r_in->filter, sizeof(r_in->filter) );
+    r_out->sinc_width = r_in->sinc_width;
+    r_out->window_type = r_in->window_type;
+    r_out->kaiser_beta = r_in->kaiser_beta;
+    r_out->transition_width = r_in->transition_width;
+    r_out->sinc_cutoff = r_in->sinc_cutoff;
+    r_out->blep_cutoff = r_in->blep_cutoff;
+    // the tables are shared, so the copy only takes references
+    if ( r_out->window_table != r_in->window_table )
+    {
+        resampler_release_table( r_out->window_table );
+        r_out->window_table = resampler_retain_table( r_in->window_table );
+    }
+    if ( r_in->quality == RESAMPLER_QUALITY_SINC )
+    {
+        if ( r_out->sinc_table != r_in->sinc_table )
+        {
+            resampler_release_table( r_out->sinc_table );
+            r_out->sinc_table = resampler_retain_table( r_in->sinc_table );
+            r_out->sinc_bank = r_out->sinc_table->data;
+        }
+    }
+    else
+        resampler_free_sinc_bank( r_out );
+    resampler_rational_copy( &r_out->rational, &r_in->rational );
+    if ( r_in->decimator )
+        *r_out->decimator = *r_in->decimator;
+    else
+        resampler_set_decimator( &r_out->decimator, 0 );
+    r_out->ramp_start = r_in->ramp_start;
+    r_out->ramp_end = r_in->ramp_end;
+    r_out->ramp_pos = r_in->ramp_pos;
+    r_out->ramp_frames = r_in->ramp_frames;
+}
+
+// A saved state is this header, the resampler struct with its pointers
+// cleared, the live half of the mirrored input ring, the output ring and,
+// for a decimating instance, the decimator state.
+// The window table and the sinc and rational banks are derived from the
+// rest and rebuilt on load. The layout is the in-memory one, so a state
+// only loads into the same version of this file built for the same ABI.
+enum { RESAMPLER_STATE_MAGIC = 0x5234354B };  // "K54R"
+enum { RESAMPLER_STATE_VERSION = 3 };
+
+typedef struct resampler_state_header
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int struct_size;
+    unsigned int buffer_size;
+    unsigned int decimator_size;
+} resampler_state_header;
+
+static size_t resampler_state_bytes(int buffer_size, size_t decimator_size)
+{
+    return sizeof(resampler_state_header) + sizeof(resampler) +
+           ( (size_t)buffer_size * 2 + SINC_WIDTH * 2 - 1 ) * sizeof(float) + decimator_size;
+}
+
+static size_t resampler_decimator_bytes(const resampler * r)
+{
+    return r->decimator ? sizeof(resampler_decimator) : 0;
+}
+
+size_t resampler_get_state_size(const void *_r)
+{
+    const resampler * r = ( const resampler * ) _r;
+    return resampler_state_bytes( r->buffer_size, resampler_decimator_bytes( r ) );
+}
+
+size_t resampler_save_state(const void *_r, void * data, size_t size)
+{
+    const resampler * r = ( const resampler * ) _r;
+    unsigned char * out = ( unsigned char * ) data;
+    size_t bytes = resampler_state_bytes( r->buffer_size, resampler_decimator_bytes( r ) );
+    resampler_state_header header;
+    resampler image;
+
+    if ( size < bytes )
+        return 0;
+
+    header.magic = RESAMPLER_STATE_MAGIC;
+    header.version = RESAMPLER_STATE_VERSION;
+    header.struct_size = sizeof(resampler);
+    header.buffer_size = r->buffer_size;
+    header.decimator_size = (unsigned int)resampler_decimator_bytes( r );
+
+    image = *r;
+    image.buffer_in = 0;
+    image.buffer_out = 0;
+    image.sinc_bank = 0;
+    image.window_table = 0;
+    image.sinc_table = 0;
+    image.rational.bank = 0;
+    image.pool = 0;
+    image.decimator = 0;
+
+    memcpy( out, &header, sizeof(header) );
+    out += sizeof(header);
+    memcpy( out, &image, sizeof(image) );
+    out += sizeof(image);
+    memcpy( out, r->buffer_in, r->buffer_size * sizeof(float) );
+    out += r->buffer_size * sizeof(float);
+    memcpy( out, r->buffer_out, ( r->buffer_size + SINC_WIDTH * 2 - 1 ) * sizeof(float) );
+    out += ( r->buffer_size + SINC_WIDTH * 2 - 1 ) * sizeof(float);
+    if ( r->decimator )
+        memcpy( out, r->decimator, sizeof(resampler_decimator) );
+
+    return bytes;
+}
+
+int resampler_load_state(void *_r, const void * data, size_t size)
+{
+    resampler * r = ( resampler * ) _r;
+    const unsigned char * in = ( const unsigned char * ) data;
+    resampler_state_header header;
+    resampler image;
+    resampler_table * window_table;
+    resampler_rational rational;
+    resampler_decimator * decimator;
+
+    if ( size < sizeof(header) )
+        return 0;
+    memcpy( &header, in, sizeof(header) );
+    if ( header.magic != RESAMPLER_STATE_MAGIC || header.version != RESAMPLER_STATE_VERSION ||
+         header.struct_size != sizeof(resampler) ||
+         header.buffer_size < resampler_buffer_size || header.buffer_size > RESAMPLER_MAX_BUFFER_SIZE ||
+         ( header.decimator_size && header.decimator_size != sizeof(resampler_decimator) ) ||
+         size != resampler_state_bytes( (int)header.buffer_size, header.decimator_size ) )
+        return 0;
+    in += sizeof(header);
+    memcpy( &image, in, sizeof(image) );
+    in += sizeof(image);
+    if ( image.buffer_size != (int)header.buffer_size )
+        return 0;
+
+    window_table = resampler_acquire_window( image.window_type,
+        resampler_window_beta( image.window_type, image.kaiser_beta, image.transition_width, image.sinc_width ) );
+    if ( !window_table )
+        return 0;
+    if ( r->buffer_size != image.buffer_size &&
+         !resampler_alloc_buffers( r, image.buffer_size ) )
+    {
+        resampler_release_table( window_table );
+        return 0;
+    }
+    decimator = r->decimator;
+    if ( header.decimator_size && !decimator &&
+         !( decimator = ( resampler_decimator * ) resampler_aligned_malloc( sizeof(resampler_decimator) ) ) )
+    {
+        resampler_release_table( window_table );
+        return 0;
+    }
+    if ( !header.decimator_size )
+    {
+        resampler_aligned_free( decimator );
+        decimator = 0;
+    }
+
+    // keep whatever banks still match the restored settings
+    image.window_table = window_table;
+    window_table = r->window_table;
+    rational = r->rational;
+    if ( rational.num != image.rational.num || rational.den != image.rational.den )
+        resampler_rational_free( &rational );
+
+    image.buffer_in = r->buffer_in;
+    image.buffer_out = r->buffer_out;
+    image.sinc_bank = r->sinc_bank;
+    image.sinc_table = r->sinc_table;
+    image.rational.bank = rational.bank;
+    if ( rational.bank )
+    {
+        image.rational.quality = rational.quality;
+        image.rational.width = rational.width;
+        image.rational.window = rational.window;
+        image.rational.cutoff = rational.cutoff;
+    }
+    image.pool = r->pool;
+    image.decimator = decimator;
+    *r = image;
+
+    memcpy( r->buffer_in, in, r->buffer_size * sizeof(float) );
+    memcpy( r->buffer_in + r->buffer_size, in, r->buffer_size * sizeof(float) );
+    in += r->buffer_size * sizeof(float);
+    memcpy( r->buffer_out, in, ( r->buffer_size + SINC_WIDTH * 2 - 1 ) * sizeof(float) );
+    in += ( r->buffer_size + SINC_WIDTH * 2 - 1 ) * sizeof(float);
+    if ( r->decimator )
+        memcpy( r->decimator, in, sizeof(resampler_decimator) );
+
+    if ( r->quality == RESAMPLER_QUALITY_SINC )
+    {
+        if ( !resampler_update_sinc_bank( r ) )
+        {
+            resampler_free_sinc_bank( r );
+            r->quality = RESAMPLER_QUALITY_CUBIC;
+        }
+    }
+    else
+        resampler_free_sinc_bank( r );
+    resampler_release_table( window_table );
+    resampler_rational_update( &r->rational, r->quality, r->sinc_width, r->window_table, r->sinc_cutoff );
+
+    return 1;
+}
+
+static void resampler_apply_rate(resampler * r);
+
+void resampler_set_quality(void *_r, int quality)
+{
+    resampler * r = ( resampler * ) _r;
+    if (quality < RESAMPLER_QUALITY_MIN)
+        quality = RESAMPLER_QUALITY_MIN;
+    else if (quality > RESAMPLER_QUALITY_MAX)
+        quality = RESAMPLER_QUALITY_MAX;
+    if ( r->quality != quality )
+    {
+        if ( quality == RESAMPLER_QUALITY_BLEP || r->quality == RESAMPLER_QUALITY_BLEP )
+        {
+            r->read_pos = 0;
+            r->read_filled = 0;
+            r->last_amp = 0;
+            r->accumulator = 0;
+            memset( r->buffer_out, 0, ( r->buffer_size + SINC_WIDTH * 2 - 1 ) * sizeof(float) );
+        }
+        r->delay_added = -1;
+        r->delay_removed = -1;
+        if ( quality == RESAMPLER_QUALITY_BLAM && r->phase_inc )
+            r->output_stage = resampler_setup_blam( r->filter, 1, 1.0 / r->phase_inc );
+        if ( quality == RESAMPLER_QUALITY_SINC )
+        {
+            // without a filter bank, settle for the next best kernel
+            if ( !resampler_update_sinc_bank( r ) )
+                quality = RESAMPLER_QUALITY_CUBIC;
+        }
+        else
+            resampler_free_sinc_bank( r );
+        resampler_rational_update( &r->rational, quality, r->sinc_width, r->window_table, r->sinc_cutoff );
+    }
+    r->quality = (unsigned char)quality;
+    if ( r->rate && resampler_decimate_stages( quality, r->rate, r->rate_den ) != resampler_decimator_stages( r->decimator ) )
+        resampler_apply_rate( r );
+}
+
+void resampler_set_sinc_width(void *_r, int width)
+{
+    resampler * r = ( resampler * ) _r;
+    int index;
+    if ( width > SINC_MAX_WIDTH )
+        width = SINC_MAX_WIDTH;
+    index = resampler_sinc_width_index( width );
+    width = SINC_WIDTH_MIN << index;
+    if ( r->sinc_width == width )
+        return;
+    // the ring must hold a full kernel plus room to write
+    if ( r->buffer_size < width * 4 )
+    {
+        if ( !resampler_alloc_buffers( r, width * 4 ) )
+            return;
+        memset( r->buffer_in, 0, resampler_buffers_samples( r->buffer_size ) * sizeof(float) );
+        resampler_clear( r );
+    }
+    r->sinc_width = width;
+    r->delay_added = -1;
+    r->delay_removed = -1;
+    // a Kaiser beta derived from the transition width depends on the width
+    resampler_update_window( r );
+    resampler_free_sinc_bank( r );
+    if ( r->quality == RESAMPLER_QUALITY_SINC && !resampler_update_sinc_bank( r ) )
+        r->quality = RESAMPLER_QUALITY_CUBIC;
+    resampler_rational_update( &r->rational, r->quality, r->sinc_width, r->window_table, r->sinc_cutoff );
+}
+
+void resampler_set_filter(void *_r, int window, double kaiser_beta, double cutoff, double transition_width)
+{
+    resampler * r = ( resampler * ) _r;
+    int old_window = r->window_type;
+    double old_beta = r->kaiser_beta, old_transition = r->transition_width;
+    if ( window < RESAMPLER_WINDOW_NUTTALL || window > RESAMPLER_WINDOW_KAISER )
+        window = RESAMPLER_WINDOW_NUTTALL;
+    r->window_type = window;
+    r->kaiser_beta = kaiser_beta > 0.0 ? kaiser_beta : 0.0;
+    r->transition_width = transition_width > 0.0 ? transition_width : 0.0;
+    if ( !resampler_update_window( r ) )
+    {
+        r->window_type = old_window;
+        r->kaiser_beta = old_beta;
+        r->transition_width = old_transition;
+        return;
+    }
+    if ( cutoff > 0.0 )
+    {
+        r->sinc_cutoff = cutoff < 1.0 ? (float)cutoff : 1.0f;
+        r->blep_cutoff = r->sinc_cutoff;
+    }
+    else
+    {
+        r->sinc_cutoff = RESAMPLER_SINC_CUTOFF;
+        r->blep_cutoff = RESAMPLER_BLEP_CUTOFF;
+    }
+    if ( r->quality == RESAMPLER_QUALITY_SINC && !resampler_update_sinc_bank( r ) )
+    {
+        resampler_free_sinc_bank( r );
+        r->quality = RESAMPLER_QUALITY_CUBIC;
+    }
+    resampler_rational_update( &r->rational, r->quality, r->sinc_width, r->window_table, r->sinc_cutoff );
+}
+
+// In input samples: with decimation, the last ring slot is taken by the
+// input that completes the next decimated sample.
+int resampler_get_free_count(void *_r)
+{
+    resampler * r = ( resampler * ) _r;
+    int free_count = r->buffer_size - r->write_filled;
+    if ( r->decimator && free_count > 0 )
+    {
+        long long inputs = ( (long long)free_count << r->decimator->stages ) - r->decimator->pending;
+        free_count = inputs > INT_MAX ? INT_MAX : (int)inputs;
+    }
+    return free_count;
+}
+
+static int resampler_min_filled(int quality, int sinc_width)
+{
+    switch (quality)
+    {
+    default:
+    case RESAMPLER_QUALITY_ZOH:
+    case RESAMPLER_QUALITY_BLEP:
+        return 1;
+            
+    case RESAMPLER_QUALITY_LINEAR:
+    case RESAMPLER_QUALITY_BLAM:
+        return 2;
+            
+    case RESAMPLER_QUALITY_CUBIC:
+        return 4;
+            
+    case RESAMPLER_QUALITY_SINC:
+        return sinc_width * 2;
+    }
+}
+
+static int resampler_input_delay(int quality, int sinc_width)
+{
+    switch (quality)
+    {
+    default:
+    case RESAMPLER_QUALITY_ZOH:
+    case RESAMPLER_QUALITY_BLEP:
+    case RESAMPLER_QUALITY_LINEAR:
+    case RESAMPLER_QUALITY_BLAM:
+        return 0;
+            
+    case RESAMPLER_QUALITY_CUBIC:
+        return 1;
+            
+    case RESAMPLER_QUALITY_SINC:
+        return sinc_width - 1;
+    }
+}
+
+static int resampler_output_delay(int quality)
+{
+    switch (quality)
+    {
+    default:
+    case RESAMPLER_QUALITY_ZOH:
+    case RESAMPLER_QUALITY_LINEAR:
+    case RESAMPLER_QUALITY_BLAM:
+    case RESAMPLER_QUALITY_CUBIC:
+    case RESAMPLER_QUALITY_SINC:
+        return 0;
+            
+    case RESAMPLER_QUALITY_BLEP:
+        return SINC_WIDTH - 1;
+    }
+}
+
+int resampler_get_padding_size()
+{
+    return SINC_WIDTH - 1;
+}
+
+int resampler_ready(void *_r)
+{
+    resampler * r = ( resampler * ) _r;
+    return r->write_filled > resampler_min_filled(r->quality, r->sinc_width);
+}
+
+void resampler_clear(void *_r)
+{
+    resampler * r = ( resampler * ) _r;
+    r->write_pos = SINC_MAX_WIDTH - 1;
+    r->write_filled = 0;
+    r->read_pos = 0;
+    r->read_filled = 0;
+    r->phase = 0;
+    r->phase_err = 0;
+    r->delay_added = -1;
+    r->delay_removed = -1;
+    memset(r->buffer_in, 0, (SINC_MAX_WIDTH - 1) * sizeof(r->buffer_in[0]));
+    memset(r->buffer_in + r->buffer_size, 0, (SINC_MAX_WIDTH - 1) * sizeof(r->buffer_in[0]));
+    if (r->quality == RESAMPLER_QUALITY_BLEP)
+    {
+        r->inv_phase = 0;
+        r->inv_phase_err = 0;
+        r->last_amp = 0;
+        r->accumulator = 0;
+        memset(r->buffer_out, 0, (r->buffer_size + SINC_WIDTH * 2 - 1) * sizeof(r->buffer_out[0]));
+    }
+    if (r->quality == RESAMPLER_QUALITY_BLAM)
+    {
+        unsigned int i, j;
+        for (i = 0, j = IIR_ORDER / 2; i < j; ++i)
+            iir_clear(r->filter + i);
+    }
+    if (r->decimator)
+        resampler_decimate_reset(r->decimator, r->decimator->stages);
+}
+
+static void resampler_rate_changed(resampler * r, double old_phase_inc)
+{
+    if (r->quality == RESAMPLER_QUALITY_BLAM && old_phase_inc != r->phase_inc)
+        r->output_stage = resampler_setup_blam(r->filter, 1, 1.0 / r->phase_inc);
+    if (r->quality == RESAMPLER_QUALITY_SINC)
+        resampler_update_sinc_bank(r);
+    resampler_rational_update(&r->rational, r->quality, r->sinc_width, r->window_table, r->sinc_cutoff);
+}
+
+// Splits the requested rate into decimator stages and the factor left for
+// the ring, which keeps an exact rational form when one was given.
+static void resampler_apply_rate(resampler * r)
+{
+    double old_phase_inc = r->phase_inc;
+    int stages = resampler_decimate_stages(r->quality, r->rate, r->rate_den);
+    if (stages != resampler_decimator_stages(r->decimator))
+        stages = resampler_set_decimator(&r->decimator, stages);
+    r->phase_inc = r->rate / (1 << stages);
+    r->inv_phase_err = 0;
+    r->ramp_pos = 0;
+    r->ramp_frames = 0;
+    if (r->rate_den)
+    {
+        unsigned int num = r->rate_num, den = r->rate_den << stages;
+        unsigned int gcd = resampler_gcd(num, den);
+        num /= gcd;
+        den /= gcd;
+        if (num != r->rational.num || den != r->rational.den)
+            resampler_rational_free(&r->rational);
+        r->rational.num = num;
+        r->rational.den = den;
+        resampler_rational_snap(den, &r->phase, &r->phase_err);
+        resampler_step_set_rational(&r->step, num, den);
+        resampler_step_set_rational(&r->inv_step, den, num);
+    }
+    else
+    {
+        r->phase_err = 0;
+        r->rational.den = 0;
+        resampler_step_set(&r->step, r->phase_inc);
+        resampler_step_set(&r->inv_step, 1.0 / r->phase_inc);
+    }
+    resampler_rate_changed(r, old_phase_inc);
+}
+
+void resampler_set_rate(void *_r, double new_factor)
+{
+    resampler * r = ( resampler * ) _r;
+    if (!resampler_factor_valid(new_factor)) return;
+    r->rate = new_factor;
+    r->rate_num = 0;
+    r->rate_den = 0;
+    resampler_apply_rate(r);
+}
+
+void resampler_set_rate_rational(void *_r, unsigned int num, unsigned int den)
+{
+    resampler * r = ( resampler * ) _r;
+    unsigned int gcd;
+    if (!num || !den) return;
+    gcd = resampler_gcd(num, den);
+    r->rate_num = num / gcd;
+    r->rate_den = den / gcd;
+    r->rate = (double)r->rate_num / r->rate_den;
+    resampler_apply_rate(r);
+}
+
+// Sets the ring to the factor of the ramp chunk that holds ramp_pos. Only
+// the position decides the factor, so it does not matter how the output
+// is split across calls.
+static void resampler_ramp_step(resampler * r)
+{
+    int chunk_start = r->ramp_pos - r->ramp_pos % RESAMPLER_RAMP_CHUNK;
+    double factor = r->ramp_start + ( r->ramp_end - r->ramp_start ) * chunk_start / r->ramp_frames;
+    resampler_step_set(&r->step, factor);
+    resampler_step_set(&r->inv_step, 1.0 / factor);
+    if (r->quality == RESAMPLER_QUALITY_BLAM)
+        r->output_stage = resampler_retune_blam(r->filter, 1, 1.0 / factor);
+}
+
+// The decimator stays sized for the smaller ramp factor: the ring holds
+// input at its rate, so resizing it here would step the output.
+static void resampler_ramp_finish(resampler * r)
+{
+    r->ramp_pos = 0;
+    r->ramp_frames = 0;
+    r->phase_inc = r->ramp_end;
+    resampler_step_set(&r->step, r->phase_inc);
+    resampler_step_set(&r->inv_step, 1.0 / r->phase_inc);
+    if (r->quality == RESAMPLER_QUALITY_BLAM)
+        r->output_stage = resampler_retune_blam(r->filter, 1, 1.0 / r->phase_inc);
+    if (r->quality == RESAMPLER_QUALITY_SINC)
+        resampler_update_sinc_bank(r);
+}
+
+void resampler_set_rate_ramp(void *_r, double start_factor, double end_factor, int frames)
+{
+    resampler * r = ( resampler * ) _r;
+    int stages;
+    if (!resampler_factor_valid(end_factor)) return;
+    if (frames <= 0 || !resampler_factor_valid(start_factor))
+    {
+        resampler_set_rate(r, end_factor);
+        return;
+    }
+    r->rate = end_factor;
+    r->rate_num = 0;
+    r->rate_den = 0;
+    // decimating for the smaller factor never cuts into the wanted band
+    stages = resampler_decimate_stages(r->quality, start_factor < end_factor ? start_factor : end_factor, 0);
+    if (stages != resampler_decimator_stages(r->decimator))
+        stages = resampler_set_decimator(&r->decimator, stages);
+    r->ramp_start = start_factor / (1 << stages);
+    r->ramp_end = end_factor / (1 << stages);
+    r->ramp_pos = 0;
+    r->ramp_frames = frames;
+    r->phase_err = 0;
+    r->inv_phase_err = 0;
+    r->rational.den = 0;
+    resampler_rational_update(&r->rational, r->quality, r->sinc_width, r->window_table, r->sinc_cutoff);
+    // the sinc bank stays put for the ramp, cut off for the larger factor
+    r->phase_inc = r->ramp_start > r->ramp_end ? r->ramp_start : r->ramp_end;
+    if (r->quality == RESAMPLER_QUALITY_SINC)
+        resampler_update_sinc_bank(r);
+    resampler_ramp_step(r);
+}
+
+void resampler_write_sample(void *_r, short s)
+{
+    resampler * r = ( resampler * ) _r;
+
+    if ( r->delay_added < 0 )
+    {
+        r->delay_added = 0;
+        r->write_filled = resampler_input_delay( r->quality, r->sinc_width );
+    }
+    
+    if ( r->write_filled < r->buffer_size )
+    {
+        double s32 = s;
+        s32 *= 256.0;
+
+        if ( r->decimator )
+        {
+            float decimated;
+            if ( !resampler_decimate_sample( r->decimator, (float)s32, &decimated ) )
+                return;
+            s32 = decimated;
+        }
+        s32 += 1e-25;
 
         if ( r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage )
         {
@@ -449,11 +2124,12 @@ void resampler_write_sample(void *_r, short s)
         }
 
         r->buffer_in[ r->write_pos ] = s32;
-        r->buffer_in[ r->write_pos + resampler_buffer_size ] = s32;
+        r->buffer_in[ r->write_pos + r->buffer_size ] = s32;
 
         ++r->write_filled;
 
-        r->write_pos = ( r->write_pos + 1 ) % resampler_buffer_size;
+        if ( ++r->write_pos == r->buffer_size )
+            r->write_pos = 0;
     }
 }
 
@@ -464,13 +2140,21 @@ void resampler_write_sample_fixed(void *_r, int s, unsigned char depth)
     if ( r->delay_added < 0 )
     {
         r->delay_added = 0;
-        r->write_filled = resampler_input_delay( r );
+        r->write_filled = resampler_input_delay( r->quality, r->sinc_width );
     }
     
-    if ( r->write_filled < resampler_buffer_size )
+    if ( r->write_filled < r->buffer_size )
     {
         double s32 = s;
-        s32 /= (double)(1 << (depth - 1));
+        s32 /= (double)(1u << (depth - 1));
+
+        if ( r->decimator )
+        {
+            float decimated;
+            if ( !resampler_decimate_sample( r->decimator, (float)s32, &decimated ) )
+                return;
+            s32 = decimated;
+        }
         s32 += 1e-25;
         
         if ( r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage )
@@ -481,11 +2165,12 @@ void resampler_write_sample_fixed(void *_r, int s, unsigned char depth)
         }
 
         r->buffer_in[ r->write_pos ] = s32;
-        r->buffer_in[ r->write_pos + resampler_buffer_size ] = s32;
+        r->buffer_in[ r->write_pos + r->buffer_size ] = s32;
         
         ++r->write_filled;
         
-        r->write_pos = ( r->write_pos + 1 ) % resampler_buffer_size;
+        if ( ++r->write_pos == r->buffer_size )
+            r->write_pos = 0;
     }
 }
 
@@ -496,12 +2181,20 @@ void resampler_write_sample_float(void *_r, float s)
     if ( r->delay_added < 0 )
     {
         r->delay_added = 0;
-        r->write_filled = resampler_input_delay( r );
+        r->write_filled = resampler_input_delay( r->quality, r->sinc_width );
     }
     
-    if ( r->write_filled < resampler_buffer_size )
+    if ( r->write_filled < r->buffer_size )
     {
         double s32 = s;
+
+        if ( r->decimator )
+        {
+            float decimated;
+            if ( !resampler_decimate_sample( r->decimator, (float)s32, &decimated ) )
+                return;
+            s32 = decimated;
+        }
         s32 += 1e-25;
 
         if ( r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage )
@@ -512,18 +2205,310 @@ void resampler_write_sample_float(void *_r, float s)
         }
 
         r->buffer_in[ r->write_pos ] = s32;
-        r->buffer_in[ r->write_pos + resampler_buffer_size ] = s32;
+        r->buffer_in[ r->write_pos + r->buffer_size ] = s32;
 
         ++r->write_filled;
 
-        r->write_pos = ( r->write_pos + 1 ) % resampler_buffer_size;
+        if ( ++r->write_pos == r->buffer_size )
+            r->write_pos = 0;
+    }
+}
+
+enum
+{
+    RESAMPLER_PCM_S16,
+    RESAMPLER_PCM_S24,
+    RESAMPLER_PCM_S32
+};
+
+enum { RESAMPLER_PCM_CHUNK = 256 };
+
+// packed little-endian 24-bit, sign extended by the arithmetic shift
+static int resampler_pcm_s24(const unsigned char * in)
+{
+    return (int)( (unsigned int)in[0] << 8 | (unsigned int)in[1] << 16 | (unsigned int)in[2] << 24 ) >> 8;
+}
+
+// Converts count integer samples to float as in[i] * scale + bias, storing
+// them to out and, unless it is null, to mirror as well. scale is a power
+// of two, so every form rounds exactly like the per-sample writers.
+static void resampler_convert_pcm(float * out, float * mirror, const void * in, int count, int format, float scale, float bias)
+{
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        float s;
+        if ( format == RESAMPLER_PCM_S16 )
+            s = (float)( (const short *)in )[i];
+        else if ( format == RESAMPLER_PCM_S24 )
+            s = (float)resampler_pcm_s24( (const unsigned char *)in + i * 3 );
+        else
+            s = (float)( (const int *)in )[i];
+        s = s * scale + bias;
+        out[i] = s;
+        if ( mirror )
+            mirror[i] = s;
+    }
+}
+
+#ifdef RESAMPLER_SSE
+static void resampler_convert_pcm_sse2(float * out, float * mirror, const void * in, int count, int format, float scale, float bias)
+{
+    const __m128 scale4 = _mm_set1_ps( scale );
+    const __m128 bias4 = _mm_set1_ps( bias );
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s32;
+        __m128 s;
+        if ( format == RESAMPLER_PCM_S16 )
+        {
+            s32 = _mm_loadl_epi64( (const __m128i *)( (const short *)in + i ) );
+            s32 = _mm_srai_epi32( _mm_unpacklo_epi16( s32, s32 ), 16 );
+        }
+        else if ( format == RESAMPLER_PCM_S24 )
+        {
+            const unsigned char * p = (const unsigned char *)in + i * 3;
+            s32 = _mm_set_epi32( resampler_pcm_s24( p + 9 ), resampler_pcm_s24( p + 6 ), resampler_pcm_s24( p + 3 ), resampler_pcm_s24( p ) );
+        }
+        else
+            s32 = _mm_loadu_si128( (const __m128i *)( (const int *)in + i ) );
+        s = _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( s32 ), scale4 ), bias4 );
+        _mm_storeu_ps( out + i, s );
+        if ( mirror )
+            _mm_storeu_ps( mirror + i, s );
+    }
+    resampler_convert_pcm( out + i, mirror ? mirror + i : 0, (const unsigned char *)in + i * ( format == RESAMPLER_PCM_S16 ? 2 : format == RESAMPLER_PCM_S24 ? 3 : 4 ), count - i, format, scale, bias );
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+TARGET("avx2")
+static void resampler_convert_pcm_avx2(float * out, float * mirror, const void * in, int count, int format, float scale, float bias)
+{
+    const __m256 scale8 = _mm256_set1_ps( scale );
+    const __m256 bias8 = _mm256_set1_ps( bias );
+    // moves the four 3-byte samples of each lane to the top of 32-bit slots
+    const __m256i s24_shuffle = _mm256_setr_epi8( -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                  -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11 );
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i s32;
+        __m256 s;
+        if ( format == RESAMPLER_PCM_S16 )
+            s32 = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i *)( (const short *)in + i ) ) );
+        else if ( format == RESAMPLER_PCM_S24 )
+        {
+            // the upper lane reads 16 bytes from sample 4, so stop while
+            // the load still ends inside the input
+            const unsigned char * p = (const unsigned char *)in + i * 3;
+            if ( ( count - i ) * 3 < 12 + 16 )
+                break;
+            s32 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)p ) ),
+                                           _mm_loadu_si128( (const __m128i *)( p + 12 ) ), 1 );
+            s32 = _mm256_srai_epi32( _mm256_shuffle_epi8( s32, s24_shuffle ), 8 );
+        }
+        else
+            s32 = _mm256_loadu_si256( (const __m256i *)( (const int *)in + i ) );
+        s = _mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( s32 ), scale8 ), bias8 );
+        _mm256_storeu_ps( out + i, s );
+        if ( mirror )
+            _mm256_storeu_ps( mirror + i, s );
+    }
+    // the tail stays in this function, clear of the SSE path's vzeroupper issue
+    for (; i < count; ++i)
+    {
+        float s;
+        if ( format == RESAMPLER_PCM_S16 )
+            s = (float)( (const short *)in )[i];
+        else if ( format == RESAMPLER_PCM_S24 )
+            s = (float)resampler_pcm_s24( (const unsigned char *)in + i * 3 );
+        else
+            s = (float)( (const int *)in )[i];
+        s = s * scale + bias;
+        out[i] = s;
+        if ( mirror )
+            mirror[i] = s;
+    }
+}
+#endif
+
+typedef void (*resampler_convert_kernel)(float *, float *, const void *, int, int, float, float);
+
+static resampler_convert_kernel resampler_convert_frames = resampler_convert_pcm;
+
+static int resampler_write_ring_float(resampler * r, const float * in, int count)
+{
+    int free_count = r->buffer_size - r->write_filled, written = 0;
+
+    if ( count > free_count )
+        count = free_count;
+
+    while ( written < count )
+    {
+        int i, span = r->buffer_size - r->write_pos;
+        float * out = r->buffer_in + r->write_pos;
+
+        if ( span > count - written )
+            span = count - written;
+
+        for (i = 0; i < span; ++i)
+            out[i] = in[i] + 1e-25;
+
+        if ( r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage )
+            resampler_iir_frames( r->filter, out, span, 1, 1 );
+
+        memcpy( out + r->buffer_size, out, span * sizeof(r->buffer_in[0]) );
+
+        in += span;
+        written += span;
+        r->write_filled += span;
+        r->write_pos = ( r->write_pos + span ) % r->buffer_size;
+    }
+
+    return written;
+}
+
+static int resampler_write_block_float(resampler * r, const float * in, int count)
+{
+    int free_count, block, written = 0;
+
+    if ( r->delay_added < 0 )
+    {
+        r->delay_added = 0;
+        r->write_filled = resampler_input_delay( r->quality, r->sinc_width );
+    }
+
+    if ( !r->decimator )
+        return resampler_write_ring_float( r, in, count );
+
+    free_count = resampler_get_free_count( r );
+    if ( count > free_count )
+        count = free_count;
+
+    block = 1 << r->decimator->stages;
+
+    // top up a partially queued sample, then run whole blocks straight from
+    // the input and queue whatever is left over
+    while ( written < count && r->decimator->pending )
+    {
+        float decimated;
+        if ( resampler_decimate_sample( r->decimator, in[written++], &decimated ) )
+            resampler_write_ring_float( r, &decimated, 1 );
+    }
+
+    while ( count - written >= block )
+    {
+        float decimated[RESAMPLER_DECIMATE_BLOCK];
+        int span = ( count - written ) & ~( block - 1 );
+        if ( span > RESAMPLER_DECIMATE_BLOCK )
+            span = RESAMPLER_DECIMATE_BLOCK;
+        resampler_write_ring_float( r, decimated, resampler_decimate_block( r->decimator, in + written, span, decimated ) );
+        written += span;
+    }
+
+    while ( written < count )
+    {
+        float decimated;
+        resampler_decimate_sample( r->decimator, in[written++], &decimated );
+    }
+
+    return written;
+}
+
+// Integer block ingest. Straight into the ring the conversion also does the
+// denormal offset and the mirror store; the BLAM input filter and the
+// decimator take converted chunks like any float block.
+static int resampler_write_block_pcm(resampler * r, const void * in, int count, int format, float scale)
+{
+    const int bytes = format == RESAMPLER_PCM_S16 ? 2 : format == RESAMPLER_PCM_S24 ? 3 : 4;
+    const unsigned char * src = ( const unsigned char * ) in;
+    int free_count, written = 0;
+
+    if ( r->delay_added < 0 )
+    {
+        r->delay_added = 0;
+        r->write_filled = resampler_input_delay( r->quality, r->sinc_width );
+    }
+
+    if ( r->decimator )
+    {
+        while ( written < count )
+        {
+            ALIGNED float chunk[RESAMPLER_PCM_CHUNK];
+            int span = count - written, done;
+            if ( span > RESAMPLER_PCM_CHUNK )
+                span = RESAMPLER_PCM_CHUNK;
+            resampler_convert_frames( chunk, 0, src + written * bytes, span, format, scale, 0.0f );
+            done = resampler_write_block_float( r, chunk, span );
+            written += done;
+            if ( done < span )
+                break;
+        }
+        return written;
+    }
+
+    free_count = r->buffer_size - r->write_filled;
+    if ( count > free_count )
+        count = free_count;
+
+    while ( written < count )
+    {
+        int span = r->buffer_size - r->write_pos;
+        float * out = r->buffer_in + r->write_pos;
+        const int filter = r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage;
+
+        if ( span > count - written )
+            span = count - written;
+
+        resampler_convert_frames( out, filter ? 0 : out + r->buffer_size, src + written * bytes, span, format, scale, 1e-25f );
+
+        if ( filter )
+        {
+            resampler_iir_frames( r->filter, out, span, 1, 1 );
+            memcpy( out + r->buffer_size, out, span * sizeof(r->buffer_in[0]) );
+        }
+
+        written += span;
+        r->write_filled += span;
+        r->write_pos = ( r->write_pos + span ) % r->buffer_size;
     }
+
+    return written;
+}
+
+int resampler_write_block_s16(void *_r, const short * in, int count)
+{
+    return resampler_write_block_pcm( ( resampler * ) _r, in, count, RESAMPLER_PCM_S16, 256.0f );
+}
+
+int resampler_write_block_s24(void *_r, const unsigned char * in, int count)
+{
+    return resampler_write_block_pcm( ( resampler * ) _r, in, count, RESAMPLER_PCM_S24, 1.0f / (float)(1 << 23) );
+}
+
+int resampler_write_block_s32(void *_r, const int * in, int count, unsigned char depth)
+{
+    resampler * r = ( resampler * ) _r;
+    int written;
+    if ( depth < 1 || depth > 32 )
+        return 0;
+    // the BLAM input filter takes a double per sample, which keeps bits of a
+    // deep sample that the float conversion would round away
+    if ( depth > 24 && r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage && !r->decimator )
+    {
+        for ( written = 0; written < count && resampler_get_free_count( r ) > 0; ++written )
+            resampler_write_sample_fixed( r, in[written], depth );
+        return written;
+    }
+    return resampler_write_block_pcm( r, in, count, RESAMPLER_PCM_S32, 1.0f / (float)(1u << (depth - 1)) );
 }
 
 static int resampler_run_zoh(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
     in_size -= 1;
     if ( in_size > 0 )
@@ -531,8 +2516,9 @@ static int resampler_run_zoh(resampler * r, float ** out_, float * out_end)
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
         
         do
         {
@@ -544,15 +2530,156 @@ static int resampler_run_zoh(resampler * r, float ** out_, float * out_end)
             sample = *in;
             *out++ = sample;
             
-            phase += phase_inc;
+            in += resampler_step_advance( &step, &phase, &phase_err );
+        }
+        while ( in < in_end );
+        
+        r->phase = phase;
+        r->phase_err = phase_err;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
+
+#ifndef RESAMPLER_NEON
+static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 1;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        float last_amp = r->last_amp;
+        unsigned int inv_phase = r->inv_phase;
+        unsigned int inv_phase_err = r->inv_phase_err;
+        const resampler_step inv_step = r->inv_step;
+        
+        const int step = r->blep_cutoff * RESAMPLER_RESOLUTION;
+        float const* const window = r->window_table->data;
+        const int window_step = RESAMPLER_RESOLUTION;
+        
+        do
+        {
+            float sample;
+            
+            if ( out + SINC_WIDTH * 2 > out_end )
+                break;
+            
+            sample = *in++ - last_amp;
+            
+            if (sample)
+            {
+                float kernel[SINC_WIDTH * 2], kernel_sum = 0.0f;
+                int phase_reduced = (inv_phase >> (32 - RESAMPLER_SHIFT));
+                int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
+                int i = SINC_WIDTH;
+
+                for (; i >= -SINC_WIDTH + 1; --i)
+                {
+                    int pos = i * step;
+                    int window_pos = i * window_step;
+                    kernel_sum += kernel[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window[abs(phase_reduced - window_pos)];
+                }
+                last_amp += sample;
+                sample /= kernel_sum;
+                for (i = 0; i < SINC_WIDTH * 2; ++i)
+                    out[i] += sample * kernel[i];
+            }
+            
+            out += resampler_step_advance( &inv_step, &inv_phase, &inv_phase_err );
+        }
+        while ( in < in_end );
+        
+        r->inv_phase = inv_phase;
+        r->inv_phase_err = inv_phase_err;
+        r->last_amp = last_amp;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
+#endif
+
+#ifdef RESAMPLER_SSE
+static int resampler_run_blep_sse(resampler * r, float ** out_, float * out_end)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 1;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        float last_amp = r->last_amp;
+        unsigned int inv_phase = r->inv_phase;
+        unsigned int inv_phase_err = r->inv_phase_err;
+        const resampler_step inv_step = r->inv_step;
+        
+        const int step = r->blep_cutoff * RESAMPLER_RESOLUTION;
+        float const* const window = r->window_table->data;
+        const int window_step = RESAMPLER_RESOLUTION;
+        
+        do
+        {
+            float sample;
+            
+            if ( out + SINC_WIDTH * 2 > out_end )
+                break;
+            
+            sample = *in++ - last_amp;
             
-            in += (int)phase;
+            if (sample)
+            {
+                float kernel_sum = 0.0f;
+                __m128 kernel[SINC_WIDTH / 2];
+                __m128 temp1, temp2;
+                __m128 samplex;
+                float *kernelf = (float*)(&kernel);
+                int phase_reduced = (inv_phase >> (32 - RESAMPLER_SHIFT));
+                int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
+                int i = SINC_WIDTH;
+
+                for (; i >= -SINC_WIDTH + 1; --i)
+                {
+                    int pos = i * step;
+                    int window_pos = i * window_step;
+                    kernel_sum += kernelf[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window[abs(phase_reduced - window_pos)];
+                }
+                last_amp += sample;
+                sample /= kernel_sum;
+                samplex = _mm_set1_ps( sample );
+                for (i = 0; i < SINC_WIDTH / 2; ++i)
+                {
+                    temp1 = _mm_load_ps( (const float *)( kernel + i ) );
+                    temp1 = _mm_mul_ps( temp1, samplex );
+                    temp2 = _mm_loadu_ps( (const float *) out + i * 4 );
+                    temp1 = _mm_add_ps( temp1, temp2 );
+                    _mm_storeu_ps( (float *) out + i * 4, temp1 );
+                }
+            }
             
-            phase = fmod(phase, 1.0f);
+            out += resampler_step_advance( &inv_step, &inv_phase, &inv_phase_err );
         }
         while ( in < in_end );
         
-        r->phase = phase;
+        r->inv_phase = inv_phase;
+        r->inv_phase_err = inv_phase_err;
+        r->last_amp = last_amp;
         *out_ = out;
         
         used = (int)(in - in_);
@@ -562,12 +2689,14 @@ static int resampler_run_zoh(resampler * r, float ** out_, float * out_end)
     
     return used;
 }
+#endif
 
-#ifndef RESAMPLER_NEON
-static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
+#ifdef RESAMPLER_AVX
+TARGET("avx2,fma")
+static int resampler_run_blep_avx2(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
     in_size -= 1;
     if ( in_size > 0 )
@@ -576,11 +2705,14 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
         float const* in = in_;
         float const* const in_end = in + in_size;
         float last_amp = r->last_amp;
-        float inv_phase = r->inv_phase;
-        float inv_phase_inc = r->inv_phase_inc;
+        unsigned int inv_phase = r->inv_phase;
+        unsigned int inv_phase_err = r->inv_phase_err;
+        const resampler_step inv_step = r->inv_step;
         
-        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
+        const int step = r->blep_cutoff * RESAMPLER_RESOLUTION;
+        float const* const window = r->window_table->data;
         const int window_step = RESAMPLER_RESOLUTION;
+        const __m256i lanes = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
         
         do
         {
@@ -593,32 +2725,42 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
             
             if (sample)
             {
-                float kernel[SINC_WIDTH * 2], kernel_sum = 0.0f;
-                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                __m256 kernel[SINC_WIDTH / 4];
+                __m256 temp1, samplex = _mm256_setzero_ps();
+                __m128 sum;
+                int phase_reduced = (inv_phase >> (32 - RESAMPLER_SHIFT));
                 int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
-                int i = SINC_WIDTH;
+                int i;
 
-                for (; i >= -SINC_WIDTH + 1; --i)
+                // gather the kernel eight taps at a time
+                for (i = 0; i < SINC_WIDTH / 4; ++i)
                 {
-                    int pos = i * step;
-                    int window_pos = i * window_step;
-                    kernel_sum += kernel[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window_lut[abs(phase_reduced - window_pos)];
+                    __m256i pos = _mm256_add_epi32( lanes, _mm256_set1_epi32( i * 8 - SINC_WIDTH + 1 ) );
+                    __m256i sinc_pos = _mm256_abs_epi32( _mm256_sub_epi32( _mm256_set1_epi32( phase_adj ), _mm256_mullo_epi32( pos, _mm256_set1_epi32( step ) ) ) );
+                    __m256i window_pos = _mm256_abs_epi32( _mm256_sub_epi32( _mm256_set1_epi32( phase_reduced ), _mm256_mullo_epi32( pos, _mm256_set1_epi32( window_step ) ) ) );
+                    kernel[i] = _mm256_mul_ps( _mm256_i32gather_ps( sinc_lut, sinc_pos, 4 ), _mm256_i32gather_ps( window, window_pos, 4 ) );
+                    samplex = _mm256_add_ps( samplex, kernel[i] );
                 }
+                sum = _mm_add_ps( _mm256_castps256_ps128( samplex ), _mm256_extractf128_ps( samplex, 1 ) );
+                sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+                sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE(0, 0, 0, 1) ) );
                 last_amp += sample;
-                sample /= kernel_sum;
-                for (i = 0; i < SINC_WIDTH * 2; ++i)
-                    out[i] += sample * kernel[i];
+                sample /= _mm_cvtss_f32( sum );
+                samplex = _mm256_set1_ps( sample );
+                for (i = 0; i < SINC_WIDTH / 4; ++i)
+                {
+                    temp1 = _mm256_loadu_ps( out + i * 8 );
+                    temp1 = _mm256_fmadd_ps( kernel[i], samplex, temp1 );
+                    _mm256_storeu_ps( out + i * 8, temp1 );
+                }
             }
             
-            inv_phase += inv_phase_inc;
-            
-            out += (int)inv_phase;
-            
-            inv_phase = fmod(inv_phase, 1.0f);
+            out += resampler_step_advance( &inv_step, &inv_phase, &inv_phase_err );
         }
         while ( in < in_end );
         
         r->inv_phase = inv_phase;
+        r->inv_phase_err = inv_phase_err;
         r->last_amp = last_amp;
         *out_ = out;
         
@@ -629,13 +2771,12 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
     
     return used;
 }
-#endif
 
-#ifdef RESAMPLER_SSE
-static int resampler_run_blep_sse(resampler * r, float ** out_, float * out_end)
+TARGET("avx512f")
+static int resampler_run_blep_avx512(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
     in_size -= 1;
     if ( in_size > 0 )
@@ -644,11 +2785,14 @@ static int resampler_run_blep_sse(resampler * r, float ** out_, float * out_end)
         float const* in = in_;
         float const* const in_end = in + in_size;
         float last_amp = r->last_amp;
-        float inv_phase = r->inv_phase;
-        float inv_phase_inc = r->inv_phase_inc;
+        unsigned int inv_phase = r->inv_phase;
+        unsigned int inv_phase_err = r->inv_phase_err;
+        const resampler_step inv_step = r->inv_step;
         
-        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
+        const int step = r->blep_cutoff * RESAMPLER_RESOLUTION;
+        float const* const window = r->window_table->data;
         const int window_step = RESAMPLER_RESOLUTION;
+        const __m512i lanes = _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
         
         do
         {
@@ -661,43 +2805,43 @@ static int resampler_run_blep_sse(resampler * r, float ** out_, float * out_end)
             
             if (sample)
             {
-                float kernel_sum = 0.0f;
-                __m128 kernel[SINC_WIDTH / 2];
-                __m128 temp1, temp2;
-                __m128 samplex;
-                float *kernelf = (float*)(&kernel);
-                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                __m512 kernel[SINC_WIDTH / 8];
+                __m512 temp1, samplex = _mm512_setzero_ps();
+                __m256 half;
+                __m128 sum;
+                int phase_reduced = (inv_phase >> (32 - RESAMPLER_SHIFT));
                 int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
-                int i = SINC_WIDTH;
+                int i;
 
-                for (; i >= -SINC_WIDTH + 1; --i)
+                for (i = 0; i < SINC_WIDTH / 8; ++i)
                 {
-                    int pos = i * step;
-                    int window_pos = i * window_step;
-                    kernel_sum += kernelf[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window_lut[abs(phase_reduced - window_pos)];
+                    __m512i pos = _mm512_add_epi32( lanes, _mm512_set1_epi32( i * 16 - SINC_WIDTH + 1 ) );
+                    __m512i sinc_pos = _mm512_abs_epi32( _mm512_sub_epi32( _mm512_set1_epi32( phase_adj ), _mm512_mullo_epi32( pos, _mm512_set1_epi32( step ) ) ) );
+                    __m512i window_pos = _mm512_abs_epi32( _mm512_sub_epi32( _mm512_set1_epi32( phase_reduced ), _mm512_mullo_epi32( pos, _mm512_set1_epi32( window_step ) ) ) );
+                    kernel[i] = _mm512_mul_ps( _mm512_i32gather_ps( sinc_pos, sinc_lut, 4 ), _mm512_i32gather_ps( window_pos, window, 4 ) );
+                    samplex = _mm512_add_ps( samplex, kernel[i] );
                 }
+                half = _mm256_add_ps( _mm512_castps512_ps256( samplex ), _mm256_castpd_ps( _mm512_extractf64x4_pd( _mm512_castps_pd( samplex ), 1 ) ) );
+                sum = _mm_add_ps( _mm256_castps256_ps128( half ), _mm256_extractf128_ps( half, 1 ) );
+                sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+                sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE(0, 0, 0, 1) ) );
                 last_amp += sample;
-                sample /= kernel_sum;
-                samplex = _mm_set1_ps( sample );
-                for (i = 0; i < SINC_WIDTH / 2; ++i)
+                sample /= _mm_cvtss_f32( sum );
+                samplex = _mm512_set1_ps( sample );
+                for (i = 0; i < SINC_WIDTH / 8; ++i)
                 {
-                    temp1 = _mm_load_ps( (const float *)( kernel + i ) );
-                    temp1 = _mm_mul_ps( temp1, samplex );
-                    temp2 = _mm_loadu_ps( (const float *) out + i * 4 );
-                    temp1 = _mm_add_ps( temp1, temp2 );
-                    _mm_storeu_ps( (float *) out + i * 4, temp1 );
+                    temp1 = _mm512_loadu_ps( out + i * 16 );
+                    temp1 = _mm512_fmadd_ps( kernel[i], samplex, temp1 );
+                    _mm512_storeu_ps( out + i * 16, temp1 );
                 }
             }
             
-            inv_phase += inv_phase_inc;
-            
-            out += (int)inv_phase;
-            
-            inv_phase = fmod(inv_phase, 1.0f);
+            out += resampler_step_advance( &inv_step, &inv_phase, &inv_phase_err );
         }
         while ( in < in_end );
         
         r->inv_phase = inv_phase;
+        r->inv_phase_err = inv_phase_err;
         r->last_amp = last_amp;
         *out_ = out;
         
@@ -714,7 +2858,7 @@ static int resampler_run_blep_sse(resampler * r, float ** out_, float * out_end)
 static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
     in_size -= 1;
     if ( in_size > 0 )
@@ -723,10 +2867,12 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
         float const* in = in_;
         float const* const in_end = in + in_size;
         float last_amp = r->last_amp;
-        float inv_phase = r->inv_phase;
-        float inv_phase_inc = r->inv_phase_inc;
+        unsigned int inv_phase = r->inv_phase;
+        unsigned int inv_phase_err = r->inv_phase_err;
+        const resampler_step inv_step = r->inv_step;
         
-        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
+        const int step = r->blep_cutoff * RESAMPLER_RESOLUTION;
+        float const* const window = r->window_table->data;
         const int window_step = RESAMPLER_RESOLUTION;
         
         do
@@ -745,7 +2891,7 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
                 float32x4_t temp1, temp2;
                 float32x4_t samplex;
                 float *kernelf = (float*)(&kernel);
-                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                int phase_reduced = (inv_phase >> (32 - RESAMPLER_SHIFT));
                 int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
                 int i = SINC_WIDTH;
 
@@ -753,7 +2899,7 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
                 {
                     int pos = i * step;
                     int window_pos = i * window_step;
-                    kernel_sum += kernelf[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window_lut[abs(phase_reduced - window_pos)];
+                    kernel_sum += kernelf[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window[abs(phase_reduced - window_pos)];
                 }
                 last_amp += sample;
                 sample /= kernel_sum;
@@ -767,15 +2913,12 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
                 }
             }
             
-            inv_phase += inv_phase_inc;
-            
-            out += (int)inv_phase;
-            
-            inv_phase = fmod(inv_phase, 1.0f);
+            out += resampler_step_advance( &inv_step, &inv_phase, &inv_phase_err );
         }
         while ( in < in_end );
         
         r->inv_phase = inv_phase;
+        r->inv_phase_err = inv_phase_err;
         r->last_amp = last_amp;
         *out_ = out;
         
@@ -791,7 +2934,7 @@ static int resampler_run_blep(resampler * r, float ** out_, float * out_end)
 static int resampler_run_linear(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
     in_size -= 2;
     if ( in_size > 0 )
@@ -799,8 +2942,9 @@ static int resampler_run_linear(resampler * r, float ** out_, float * out_end)
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
         
         do
         {
@@ -809,18 +2953,15 @@ static int resampler_run_linear(resampler * r, float ** out_, float * out_end)
             if ( out >= out_end )
                 break;
             
-            sample = in[0] + (in[1] - in[0]) * phase;
+            sample = in[0] + (in[1] - in[0]) * PHASE_TO_FLOAT(phase);
             *out++ = sample;
             
-            phase += phase_inc;
-            
-            in += (int)phase;
-            
-            phase = fmod(phase, 1.0f);
+            in += resampler_step_advance( &step, &phase, &phase_err );
         }
         while ( in < in_end );
         
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
         
         used = (int)(in - in_);
@@ -834,7 +2975,7 @@ static int resampler_run_linear(resampler * r, float ** out_, float * out_end)
 static int resampler_run_blam(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     unsigned int output_stage = r->output_stage;
     int used = 0;
     in_size -= 2;
@@ -843,36 +2984,276 @@ static int resampler_run_blam(resampler * r, float ** out_, float * out_end)
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        
+        do
+        {
+            if ( out >= out_end )
+                break;
+            
+            *out++ = in[0] + (in[1] - in[0]) * PHASE_TO_FLOAT(phase);
+            
+            in += resampler_step_advance( &step, &phase, &phase_err );
+        }
+        while ( in < in_end );
+
+        if ( output_stage )
+            resampler_iir_frames( r->filter, *out_, (int)(out - *out_), 1, 1 );
+        
+        r->phase = phase;
+        r->phase_err = phase_err;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
+
+#ifndef RESAMPLER_NEON
+static int resampler_run_cubic(resampler * r, float ** out_, float * out_end)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 4;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        
+        do
+        {
+            float const* kernel;
+            int i;
+            float sample;
+            
+            if ( out >= out_end )
+                break;
+            
+            kernel = cubic_lut + (phase >> (32 - RESAMPLER_SHIFT)) * 4;
+            
+            for (sample = 0, i = 0; i < 4; ++i)
+                sample += in[i] * kernel[i];
+            *out++ = sample;
+            
+            in += resampler_step_advance( &step, &phase, &phase_err );
+        }
+        while ( in < in_end );
+        
+        r->phase = phase;
+        r->phase_err = phase_err;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
+#endif
+
+#ifdef RESAMPLER_SSE
+static int resampler_run_cubic_sse(resampler * r, float ** out_, float * out_end)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 4;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        
+        do
+        {
+            __m128 temp1, temp2;
+            __m128 samplex = _mm_setzero_ps();
+            
+            if ( out >= out_end )
+                break;
+            
+            temp1 = _mm_loadu_ps( (const float *)( in ) );
+            temp2 = _mm_load_ps( (const float *)( cubic_lut + (phase >> (32 - RESAMPLER_SHIFT)) * 4 ) );
+            temp1 = _mm_mul_ps( temp1, temp2 );
+            samplex = _mm_add_ps( samplex, temp1 );
+            temp1 = _mm_movehl_ps( temp1, samplex );
+            samplex = _mm_add_ps( samplex, temp1 );
+            temp1 = samplex;
+            temp1 = _mm_shuffle_ps( temp1, samplex, _MM_SHUFFLE(0, 0, 0, 1) );
+            samplex = _mm_add_ps( samplex, temp1 );
+            _mm_store_ss( out, samplex );
+            ++out;
+            
+            in += resampler_step_advance( &step, &phase, &phase_err );
+        }
+        while ( in < in_end );
+        
+        r->phase = phase;
+        r->phase_err = phase_err;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+TARGET("avx2,fma")
+static int resampler_run_cubic_avx2(resampler * r, float ** out_, float * out_end)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 4;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
         
         do
         {
-            double sample;
+            float const* ins[2];
+            float const* kernels[2];
+            int count = 0;
             
             if ( out >= out_end )
                 break;
             
-            sample = in[0] + (in[1] - in[0]) * phase;
+            // two output samples per 256-bit multiply, one per 128-bit lane
+            do
+            {
+                ins[count] = in;
+                kernels[count] = cubic_lut + (phase >> (32 - RESAMPLER_SHIFT)) * 4;
+                ++count;
+
+                in += resampler_step_advance( &step, &phase, &phase_err );
+            }
+            while ( count < 2 && out + count < out_end && in < in_end );
 
-            if ( output_stage )
+            if ( count == 2 )
+            {
+                __m256 temp1 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( ins[0] ) ), _mm_loadu_ps( ins[1] ), 1 );
+                __m256 temp2 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_load_ps( kernels[0] ) ), _mm_load_ps( kernels[1] ), 1 );
+                temp1 = _mm256_mul_ps( temp1, temp2 );
+                temp1 = _mm256_hadd_ps( temp1, temp1 );
+                temp1 = _mm256_hadd_ps( temp1, temp1 );
+                out[0] = _mm_cvtss_f32( _mm256_castps256_ps128( temp1 ) );
+                out[1] = _mm_cvtss_f32( _mm256_extractf128_ps( temp1, 1 ) );
+            }
+            else
             {
-                unsigned int i, j;
-                for (i = 0, j = IIR_ORDER / 2; i < j; ++i)
-                    sample = iir_process(r->filter + i, sample);
+                __m128 temp1 = _mm_mul_ps( _mm_loadu_ps( ins[0] ), _mm_load_ps( kernels[0] ) );
+                temp1 = _mm_hadd_ps( temp1, temp1 );
+                temp1 = _mm_hadd_ps( temp1, temp1 );
+                _mm_store_ss( out, temp1 );
             }
+            out += count;
+        }
+        while ( in < in_end );
+        
+        r->phase = phase;
+        r->phase_err = phase_err;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
 
-            *out++ = sample;
-            
-            phase += phase_inc;
+TARGET("avx512f")
+static int resampler_run_cubic_avx512(resampler * r, float ** out_, float * out_end)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 4;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        const __m512i gather = _mm512_setr_epi32( 0, 4, 8, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+        
+        do
+        {
+            float const* ins[4];
+            float const* kernels[4];
+            int i, count = 0;
             
-            in += (int)phase;
+            if ( out >= out_end )
+                break;
             
-            phase = fmod(phase, 1.0f);
+            // four output samples per 512-bit multiply, one per 128-bit lane
+            do
+            {
+                ins[count] = in;
+                kernels[count] = cubic_lut + (phase >> (32 - RESAMPLER_SHIFT)) * 4;
+                ++count;
+
+                in += resampler_step_advance( &step, &phase, &phase_err );
+            }
+            while ( count < 4 && out + count < out_end && in < in_end );
+
+            if ( count == 4 )
+            {
+                __m512 temp1 = _mm512_castps128_ps512( _mm_loadu_ps( ins[0] ) );
+                __m512 temp2 = _mm512_castps128_ps512( _mm_load_ps( kernels[0] ) );
+                temp1 = _mm512_insertf32x4( temp1, _mm_loadu_ps( ins[1] ), 1 );
+                temp2 = _mm512_insertf32x4( temp2, _mm_load_ps( kernels[1] ), 1 );
+                temp1 = _mm512_insertf32x4( temp1, _mm_loadu_ps( ins[2] ), 2 );
+                temp2 = _mm512_insertf32x4( temp2, _mm_load_ps( kernels[2] ), 2 );
+                temp1 = _mm512_insertf32x4( temp1, _mm_loadu_ps( ins[3] ), 3 );
+                temp2 = _mm512_insertf32x4( temp2, _mm_load_ps( kernels[3] ), 3 );
+                temp1 = _mm512_mul_ps( temp1, temp2 );
+                temp1 = _mm512_add_ps( temp1, _mm512_permute_ps( temp1, _MM_SHUFFLE(2, 3, 0, 1) ) );
+                temp1 = _mm512_add_ps( temp1, _mm512_permute_ps( temp1, _MM_SHUFFLE(1, 0, 3, 2) ) );
+                temp1 = _mm512_permutexvar_ps( gather, temp1 );
+                _mm_storeu_ps( out, _mm512_castps512_ps128( temp1 ) );
+            }
+            else
+            {
+                for (i = 0; i < count; ++i)
+                {
+                    __m128 temp1 = _mm_mul_ps( _mm_loadu_ps( ins[i] ), _mm_load_ps( kernels[i] ) );
+                    temp1 = _mm_hadd_ps( temp1, temp1 );
+                    temp1 = _mm_hadd_ps( temp1, temp1 );
+                    _mm_store_ss( out + i, temp1 );
+                }
+            }
+            out += count;
         }
         while ( in < in_end );
         
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
         
         used = (int)(in - in_);
@@ -882,12 +3263,13 @@ static int resampler_run_blam(resampler * r, float ** out_, float * out_end)
     
     return used;
 }
+#endif
 
-#ifndef RESAMPLER_NEON
+#ifdef RESAMPLER_NEON
 static int resampler_run_cubic(resampler * r, float ** out_, float * out_end)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
     in_size -= 4;
     if ( in_size > 0 )
@@ -895,196 +3277,300 @@ static int resampler_run_cubic(resampler * r, float ** out_, float * out_end)
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
-        
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        
+        do
+        {
+            float32x4_t temp1, temp2;
+            float32x2_t half;
+            
+            if ( out >= out_end )
+                break;
+            
+            temp1 = vld1q_f32( (const float32_t *)( in ) );
+            temp2 = vld1q_f32( (const float32_t *)( cubic_lut + (phase >> (32 - RESAMPLER_SHIFT)) * 4 ) );
+            temp1 = vmulq_f32( temp1, temp2 );
+            half = vadd_f32(vget_high_f32(temp1), vget_low_f32(temp1));
+            *out++ = vget_lane_f32(vpadd_f32(half, half), 0);
+            
+            in += resampler_step_advance( &step, &phase, &phase_err );
+        }
+        while ( in < in_end );
+        
+        r->phase = phase;
+        r->phase_err = phase_err;
+        *out_ = out;
+        
+        used = (int)(in - in_);
+        
+        r->write_filled -= used;
+    }
+    
+    return used;
+}
+#endif
+
+// The sinc kernels are written against a width argument and stamped out once
+// per supported width, so each copy runs its tap loop with a constant count.
+#define RESAMPLER_SINC_KERNELS(name, attr) \
+attr static int name##_8(resampler * r, float ** out_, float * out_end) { return name##_width( r, out_, out_end, 8 ); } \
+attr static int name##_16(resampler * r, float ** out_, float * out_end) { return name##_width( r, out_, out_end, 16 ); } \
+attr static int name##_32(resampler * r, float ** out_, float * out_end) { return name##_width( r, out_, out_end, 32 ); } \
+attr static int name##_64(resampler * r, float ** out_, float * out_end) { return name##_width( r, out_, out_end, 64 ); }
+
+#ifndef RESAMPLER_NEON
+static FORCE_INLINE int resampler_run_sinc_width(resampler * r, float ** out_, float * out_end, const int width)
+{
+    int in_size = r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= width * 2;
+    if ( in_size > 0 )
+    {
+        float* out = *out_;
+        float const* in = in_;
+        float const* const in_end = in + in_size;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        float const* bank = r->sinc_bank;
+
         do
         {
-            float * kernel;
-            int i;
-            float sample;
-            
+            float const* kernel;
+            float sample0, sample1, phase_frac;
+            int i, phase_row;
+
             if ( out >= out_end )
                 break;
-            
-            kernel = cubic_lut + (int)(phase * RESAMPLER_RESOLUTION) * 4;
-            
-            for (sample = 0, i = 0; i < 4; ++i)
-                sample += in[i] * kernel[i];
-            *out++ = sample;
-            
-            phase += phase_inc;
-            
-            in += (int)phase;
-            
-            phase = fmod(phase, 1.0f);
+
+            phase_row = phase >> (32 - SINC_PHASE_SHIFT);
+            phase_frac = PHASE_TO_FLOAT(phase << SINC_PHASE_SHIFT);
+            kernel = bank + phase_row * width * 2;
+
+            for (sample0 = 0, sample1 = 0, i = 0; i < width * 2; ++i)
+            {
+                sample0 += in[i] * kernel[i];
+                sample1 += in[i] * kernel[i + width * 2];
+            }
+            *out++ = sample0 + (sample1 - sample0) * phase_frac;
+
+            in += resampler_step_advance( &step, &phase, &phase_err );
         }
         while ( in < in_end );
-        
+
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
-        
+
         used = (int)(in - in_);
-        
+
         r->write_filled -= used;
     }
-    
+
     return used;
 }
+
+RESAMPLER_SINC_KERNELS(resampler_run_sinc, )
 #endif
 
 #ifdef RESAMPLER_SSE
-static int resampler_run_cubic_sse(resampler * r, float ** out_, float * out_end)
+static FORCE_INLINE int resampler_run_sinc_sse_width(resampler * r, float ** out_, float * out_end, const int width)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
-    in_size -= 4;
+    in_size -= width * 2;
     if ( in_size > 0 )
     {
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
-        
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        float const* bank = r->sinc_bank;
+
         do
         {
             __m128 temp1, temp2;
-            __m128 samplex = _mm_setzero_ps();
-            
+            __m128 sample0 = _mm_setzero_ps();
+            __m128 sample1 = _mm_setzero_ps();
+            float const* kernel;
+            float phase_frac;
+            int i, phase_row;
+
             if ( out >= out_end )
                 break;
-            
-            temp1 = _mm_loadu_ps( (const float *)( in ) );
-            temp2 = _mm_load_ps( (const float *)( cubic_lut + (int)(phase * RESAMPLER_RESOLUTION) * 4 ) );
-            temp1 = _mm_mul_ps( temp1, temp2 );
-            samplex = _mm_add_ps( samplex, temp1 );
-            temp1 = _mm_movehl_ps( temp1, samplex );
-            samplex = _mm_add_ps( samplex, temp1 );
-            temp1 = samplex;
-            temp1 = _mm_shuffle_ps( temp1, samplex, _MM_SHUFFLE(0, 0, 0, 1) );
-            samplex = _mm_add_ps( samplex, temp1 );
-            _mm_store_ss( out, samplex );
+
+            phase_row = phase >> (32 - SINC_PHASE_SHIFT);
+            phase_frac = PHASE_TO_FLOAT(phase << SINC_PHASE_SHIFT);
+            kernel = bank + phase_row * width * 2;
+
+            for (i = 0; i < width / 2; ++i)
+            {
+                temp1 = _mm_loadu_ps( (const float *)( in + i * 4 ) );
+                temp2 = _mm_load_ps( kernel + i * 4 );
+                sample0 = _mm_add_ps( sample0, _mm_mul_ps( temp1, temp2 ) );
+                temp2 = _mm_load_ps( kernel + width * 2 + i * 4 );
+                sample1 = _mm_add_ps( sample1, _mm_mul_ps( temp1, temp2 ) );
+            }
+            // interpolate between the two phases before the horizontal sum
+            sample1 = _mm_sub_ps( sample1, sample0 );
+            sample1 = _mm_mul_ps( sample1, _mm_set1_ps( phase_frac ) );
+            sample0 = _mm_add_ps( sample0, sample1 );
+            temp1 = _mm_movehl_ps( temp1, sample0 );
+            sample0 = _mm_add_ps( sample0, temp1 );
+            temp1 = sample0;
+            temp1 = _mm_shuffle_ps( temp1, sample0, _MM_SHUFFLE(0, 0, 0, 1) );
+            sample0 = _mm_add_ps( sample0, temp1 );
+            _mm_store_ss( out, sample0 );
             ++out;
-            
-            phase += phase_inc;
-            
-            in += (int)phase;
-            
-            phase = fmod(phase, 1.0f);
+
+            in += resampler_step_advance( &step, &phase, &phase_err );
         }
         while ( in < in_end );
-        
+
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
-        
+
         used = (int)(in - in_);
-        
+
         r->write_filled -= used;
     }
-    
+
     return used;
 }
+
+RESAMPLER_SINC_KERNELS(resampler_run_sinc_sse, )
 #endif
 
-#ifdef RESAMPLER_NEON
-static int resampler_run_cubic(resampler * r, float ** out_, float * out_end)
+#ifdef RESAMPLER_AVX
+TARGET("avx2,fma")
+static FORCE_INLINE int resampler_run_sinc_avx2_width(resampler * r, float ** out_, float * out_end, const int width)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
-    in_size -= 4;
+    in_size -= width * 2;
     if ( in_size > 0 )
     {
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
-        
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        float const* bank = r->sinc_bank;
+
         do
         {
-            float32x4_t temp1, temp2;
-            float32x2_t half;
-            
+            __m256 temp1;
+            __m256 sample0 = _mm256_setzero_ps();
+            __m256 sample1 = _mm256_setzero_ps();
+            __m128 sum;
+            float const* kernel;
+            float phase_frac;
+            int i, phase_row;
+
             if ( out >= out_end )
                 break;
-            
-            temp1 = vld1q_f32( (const float32_t *)( in ) );
-            temp2 = vld1q_f32( (const float32_t *)( cubic_lut + (int)(phase * RESAMPLER_RESOLUTION) * 4 ) );
-            temp1 = vmulq_f32( temp1, temp2 );
-            half = vadd_f32(vget_high_f32(temp1), vget_low_f32(temp1));
-            *out++ = vget_lane_f32(vpadd_f32(half, half), 0);
-            
-            phase += phase_inc;
-            
-            in += (int)phase;
-            
-            phase = fmod(phase, 1.0f);
+
+            phase_row = phase >> (32 - SINC_PHASE_SHIFT);
+            phase_frac = PHASE_TO_FLOAT(phase << SINC_PHASE_SHIFT);
+            kernel = bank + phase_row * width * 2;
+
+            for (i = 0; i < width / 4; ++i)
+            {
+                temp1 = _mm256_loadu_ps( in + i * 8 );
+                sample0 = _mm256_fmadd_ps( temp1, _mm256_load_ps( kernel + i * 8 ), sample0 );
+                sample1 = _mm256_fmadd_ps( temp1, _mm256_load_ps( kernel + width * 2 + i * 8 ), sample1 );
+            }
+            sample1 = _mm256_sub_ps( sample1, sample0 );
+            sample0 = _mm256_fmadd_ps( sample1, _mm256_set1_ps( phase_frac ), sample0 );
+            sum = _mm_add_ps( _mm256_castps256_ps128( sample0 ), _mm256_extractf128_ps( sample0, 1 ) );
+            sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+            sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE(0, 0, 0, 1) ) );
+            _mm_store_ss( out, sum );
+            ++out;
+
+            in += resampler_step_advance( &step, &phase, &phase_err );
         }
         while ( in < in_end );
-        
+
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
-        
+
         used = (int)(in - in_);
-        
+
         r->write_filled -= used;
     }
-    
+
     return used;
 }
-#endif
 
-#ifndef RESAMPLER_NEON
-static int resampler_run_sinc(resampler * r, float ** out_, float * out_end)
+RESAMPLER_SINC_KERNELS(resampler_run_sinc_avx2, TARGET("avx2,fma"))
+
+TARGET("avx512f")
+static FORCE_INLINE int resampler_run_sinc_avx512_width(resampler * r, float ** out_, float * out_end, const int width)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
-    in_size -= SINC_WIDTH * 2;
+    in_size -= width * 2;
     if ( in_size > 0 )
     {
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
-
-        int step = phase_inc > 1.0f ? (int)(RESAMPLER_RESOLUTION / phase_inc * RESAMPLER_SINC_CUTOFF) : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
-        int window_step = RESAMPLER_RESOLUTION;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        float const* bank = r->sinc_bank;
 
         do
         {
-            float kernel[SINC_WIDTH * 2], kernel_sum = 0.0;
-            int i = SINC_WIDTH;
-            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
-            int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
-            float sample;
+            __m512 temp1;
+            __m512 sample0 = _mm512_setzero_ps();
+            __m512 sample1 = _mm512_setzero_ps();
+            __m256 half;
+            __m128 sum;
+            float const* kernel;
+            float phase_frac;
+            int i, phase_row;
 
             if ( out >= out_end )
                 break;
 
-            for (; i >= -SINC_WIDTH + 1; --i)
+            phase_row = phase >> (32 - SINC_PHASE_SHIFT);
+            phase_frac = PHASE_TO_FLOAT(phase << SINC_PHASE_SHIFT);
+            kernel = bank + phase_row * width * 2;
+
+            for (i = 0; i < width / 8; ++i)
             {
-                int pos = i * step;
-                int window_pos = i * window_step;
-                kernel_sum += kernel[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window_lut[abs(phase_reduced - window_pos)];
+                temp1 = _mm512_loadu_ps( in + i * 16 );
+                sample0 = _mm512_fmadd_ps( temp1, _mm512_load_ps( kernel + i * 16 ), sample0 );
+                sample1 = _mm512_fmadd_ps( temp1, _mm512_load_ps( kernel + width * 2 + i * 16 ), sample1 );
             }
-            for (sample = 0, i = 0; i < SINC_WIDTH * 2; ++i)
-                sample += in[i] * kernel[i];
-            *out++ = (float)(sample / kernel_sum);
-
-            phase += phase_inc;
-
-            in += (int)phase;
+            sample1 = _mm512_sub_ps( sample1, sample0 );
+            sample0 = _mm512_fmadd_ps( sample1, _mm512_set1_ps( phase_frac ), sample0 );
+            half = _mm256_add_ps( _mm512_castps512_ps256( sample0 ), _mm256_castpd_ps( _mm512_extractf64x4_pd( _mm512_castps_pd( sample0 ), 1 ) ) );
+            sum = _mm_add_ps( _mm256_castps256_ps128( half ), _mm256_extractf128_ps( half, 1 ) );
+            sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+            sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE(0, 0, 0, 1) ) );
+            _mm_store_ss( out, sum );
+            ++out;
 
-            phase = fmod(phase, 1.0f);
+            in += resampler_step_advance( &step, &phase, &phase_err );
         }
         while ( in < in_end );
 
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -1094,175 +3580,451 @@ static int resampler_run_sinc(resampler * r, float ** out_, float * out_end)
 
     return used;
 }
+
+RESAMPLER_SINC_KERNELS(resampler_run_sinc_avx512, TARGET("avx512f"))
 #endif
 
-#ifdef RESAMPLER_SSE
-static int resampler_run_sinc_sse(resampler * r, float ** out_, float * out_end)
+#ifdef RESAMPLER_NEON
+static FORCE_INLINE int resampler_run_sinc_width(resampler * r, float ** out_, float * out_end, const int width)
 {
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
-    in_size -= SINC_WIDTH * 2;
+    in_size -= width * 2;
     if ( in_size > 0 )
     {
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
-        
-        int step = phase_inc > 1.0f ? (int)(RESAMPLER_RESOLUTION / phase_inc * RESAMPLER_SINC_CUTOFF) : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
-        int window_step = RESAMPLER_RESOLUTION;
-        
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        float const* bank = r->sinc_bank;
+
         do
         {
-            // accumulate in extended precision
-            float kernel_sum = 0.0;
-            __m128 kernel[SINC_WIDTH / 2];
-            __m128 temp1, temp2;
-            __m128 samplex = _mm_setzero_ps();
-            float *kernelf = (float*)(&kernel);
-            int i = SINC_WIDTH;
-            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
-            int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
-            
+            float32x4_t temp1;
+            float32x4_t sample0 = vdupq_n_f32(0);
+            float32x4_t sample1 = vdupq_n_f32(0);
+            float32x2_t half;
+            float const* kernel;
+            float phase_frac;
+            int i, phase_row;
+
             if ( out >= out_end )
                 break;
-            
-            for (; i >= -SINC_WIDTH + 1; --i)
-            {
-                int pos = i * step;
-                int window_pos = i * window_step;
-                kernel_sum += kernelf[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window_lut[abs(phase_reduced - window_pos)];
-            }
-            for (i = 0; i < SINC_WIDTH / 2; ++i)
+
+            phase_row = phase >> (32 - SINC_PHASE_SHIFT);
+            phase_frac = PHASE_TO_FLOAT(phase << SINC_PHASE_SHIFT);
+            kernel = bank + phase_row * width * 2;
+
+            for (i = 0; i < width / 2; ++i)
             {
-                temp1 = _mm_loadu_ps( (const float *)( in + i * 4 ) );
-                temp2 = _mm_load_ps( (const float *)( kernel + i ) );
-                temp1 = _mm_mul_ps( temp1, temp2 );
-                samplex = _mm_add_ps( samplex, temp1 );
+                temp1 = vld1q_f32( (const float32_t *)( in + i * 4 ) );
+                sample0 = vmlaq_f32( sample0, temp1, vld1q_f32( kernel + i * 4 ) );
+                sample1 = vmlaq_f32( sample1, temp1, vld1q_f32( kernel + width * 2 + i * 4 ) );
             }
-            kernel_sum = 1.0 / kernel_sum;
-            temp1 = _mm_movehl_ps( temp1, samplex );
-            samplex = _mm_add_ps( samplex, temp1 );
-            temp1 = samplex;
-            temp1 = _mm_shuffle_ps( temp1, samplex, _MM_SHUFFLE(0, 0, 0, 1) );
-            samplex = _mm_add_ps( samplex, temp1 );
-            temp1 = _mm_set_ss( kernel_sum );
-            samplex = _mm_mul_ps( samplex, temp1 );
-            _mm_store_ss( out, samplex );
-            ++out;
-            
-            phase += phase_inc;
-            
-            in += (int)phase;
-            
-            phase = fmod(phase, 1.0f);
+            sample1 = vsubq_f32( sample1, sample0 );
+            sample0 = vmlaq_f32( sample0, sample1, vmovq_n_f32(phase_frac) );
+            half = vadd_f32(vget_high_f32(sample0), vget_low_f32(sample0));
+            *out++ = vget_lane_f32(vpadd_f32(half, half), 0);
+
+            in += resampler_step_advance( &step, &phase, &phase_err );
         }
         while ( in < in_end );
-        
+
         r->phase = phase;
+        r->phase_err = phase_err;
         *out_ = out;
-        
+
         used = (int)(in - in_);
-        
+
         r->write_filled -= used;
     }
-    
+
     return used;
 }
+
+RESAMPLER_SINC_KERNELS(resampler_run_sinc, )
+#endif
+
+// Multichannel dot product: for each of `channels` interleaved channels
+// starting at in/out, out[c] = sum(in[t * stride + c] * kernel[t]).
+static void resampler_mc_dot(float * out, const float * in, int stride, const float * kernel, int taps, int channels)
+{
+    int c, t;
+    for (c = 0; c < channels; ++c)
+        out[c] = 0;
+    for (t = 0; t < taps; ++t)
+    {
+        float k = kernel[t];
+        for (c = 0; c < channels; ++c)
+            out[c] += in[t * stride + c] * k;
+    }
+}
+
+#ifdef RESAMPLER_SSE
+static void resampler_mc_dot_sse(float * out, const float * in, int stride, const float * kernel, int taps, int channels)
+{
+    __m128 temp1, samplex;
+    int c = 0, t;
+    if ( stride == 2 && channels == 2 )
+    {
+        // stereo: two frames per vector, kernel taps duplicated across each pair
+        samplex = _mm_setzero_ps();
+        for (t = 0; t + 2 <= taps; t += 2)
+        {
+            temp1 = _mm_set_ps( kernel[t + 1], kernel[t + 1], kernel[t], kernel[t] );
+            samplex = _mm_add_ps( samplex, _mm_mul_ps( _mm_loadu_ps( in + t * 2 ), temp1 ) );
+        }
+        samplex = _mm_add_ps( samplex, _mm_movehl_ps( samplex, samplex ) );
+        _mm_storel_pi( (__m64 *) out, samplex );
+        for (; t < taps; ++t)
+        {
+            out[0] += in[t * 2] * kernel[t];
+            out[1] += in[t * 2 + 1] * kernel[t];
+        }
+        return;
+    }
+    for (; c + 4 <= channels; c += 4)
+    {
+        samplex = _mm_setzero_ps();
+        for (t = 0; t < taps; ++t)
+        {
+            temp1 = _mm_loadu_ps( in + t * stride + c );
+            samplex = _mm_add_ps( samplex, _mm_mul_ps( temp1, _mm_set1_ps( kernel[t] ) ) );
+        }
+        _mm_storeu_ps( out + c, samplex );
+    }
+    if ( c < channels )
+        resampler_mc_dot( out + c, in + c, stride, kernel, taps, channels - c );
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+TARGET("avx2,fma")
+static void resampler_mc_dot_avx2(float * out, const float * in, int stride, const float * kernel, int taps, int channels)
+{
+    int c = 0, t;
+    for (; c + 8 <= channels; c += 8)
+    {
+        __m256 samplex = _mm256_setzero_ps();
+        for (t = 0; t < taps; ++t)
+            samplex = _mm256_fmadd_ps( _mm256_loadu_ps( in + t * stride + c ), _mm256_set1_ps( kernel[t] ), samplex );
+        _mm256_storeu_ps( out + c, samplex );
+    }
+    if ( c < channels )
+        resampler_mc_dot_sse( out + c, in + c, stride, kernel, taps, channels - c );
+}
+
+TARGET("avx512f")
+static void resampler_mc_dot_avx512(float * out, const float * in, int stride, const float * kernel, int taps, int channels)
+{
+    int c = 0, t;
+    for (; c + 16 <= channels; c += 16)
+    {
+        __m512 samplex = _mm512_setzero_ps();
+        for (t = 0; t < taps; ++t)
+            samplex = _mm512_fmadd_ps( _mm512_loadu_ps( in + t * stride + c ), _mm512_set1_ps( kernel[t] ), samplex );
+        _mm512_storeu_ps( out + c, samplex );
+    }
+    if ( c < channels )
+        resampler_mc_dot_avx2( out + c, in + c, stride, kernel, taps, channels - c );
+}
+#endif
+
+#ifdef RESAMPLER_NEON
+static void resampler_mc_dot_neon(float * out, const float * in, int stride, const float * kernel, int taps, int channels)
+{
+    int c = 0, t;
+    for (; c + 4 <= channels; c += 4)
+    {
+        float32x4_t samplex = vdupq_n_f32(0);
+        for (t = 0; t < taps; ++t)
+            samplex = vmlaq_f32( samplex, vld1q_f32( in + t * stride + c ), vdupq_n_f32( kernel[t] ) );
+        vst1q_f32( out + c, samplex );
+    }
+    if ( c < channels )
+        resampler_mc_dot( out + c, in + c, stride, kernel, taps, channels - c );
+}
+#endif
+
+// Single channel dot product over taps, a multiple of 4, with the kernel
+// 16 byte aligned.
+static float resampler_dot(const float * in, const float * kernel, int taps)
+{
+    float sample = 0;
+    int t;
+    for (t = 0; t < taps; ++t)
+        sample += in[t] * kernel[t];
+    return sample;
+}
+
+#ifdef RESAMPLER_SSE
+static float resampler_dot_sse(const float * in, const float * kernel, int taps)
+{
+    __m128 samplex = _mm_setzero_ps();
+    int t;
+    for (t = 0; t < taps; t += 4)
+        samplex = _mm_add_ps( samplex, _mm_mul_ps( _mm_loadu_ps( in + t ), _mm_load_ps( kernel + t ) ) );
+    samplex = _mm_add_ps( samplex, _mm_movehl_ps( samplex, samplex ) );
+    samplex = _mm_add_ss( samplex, _mm_shuffle_ps( samplex, samplex, _MM_SHUFFLE(1, 1, 1, 1) ) );
+    return _mm_cvtss_f32( samplex );
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+TARGET("avx2,fma")
+static float resampler_dot_avx2(const float * in, const float * kernel, int taps)
+{
+    __m256 samplex = _mm256_setzero_ps();
+    __m128 sample;
+    int t;
+    if ( taps < 8 )
+        return resampler_dot_sse( in, kernel, taps );
+    for (t = 0; t < taps; t += 8)
+        samplex = _mm256_fmadd_ps( _mm256_loadu_ps( in + t ), _mm256_loadu_ps( kernel + t ), samplex );
+    sample = _mm_add_ps( _mm256_castps256_ps128( samplex ), _mm256_extractf128_ps( samplex, 1 ) );
+    sample = _mm_add_ps( sample, _mm_movehl_ps( sample, sample ) );
+    sample = _mm_add_ss( sample, _mm_shuffle_ps( sample, sample, _MM_SHUFFLE(1, 1, 1, 1) ) );
+    return _mm_cvtss_f32( sample );
+}
+
+TARGET("avx512f")
+static float resampler_dot_avx512(const float * in, const float * kernel, int taps)
+{
+    __m512 samplex = _mm512_setzero_ps();
+    int t;
+    if ( taps < 16 )
+        return resampler_dot_avx2( in, kernel, taps );
+    for (t = 0; t < taps; t += 16)
+        samplex = _mm512_fmadd_ps( _mm512_loadu_ps( in + t ), _mm512_loadu_ps( kernel + t ), samplex );
+    return _mm512_reduce_add_ps( samplex );
+}
+#endif
+
+#ifdef RESAMPLER_NEON
+static float resampler_dot_neon(const float * in, const float * kernel, int taps)
+{
+    float32x4_t samplex = vdupq_n_f32(0);
+    float32x2_t half;
+    int t;
+    for (t = 0; t < taps; t += 4)
+        samplex = vmlaq_f32( samplex, vld1q_f32( in + t ), vld1q_f32( kernel + t ) );
+    half = vadd_f32( vget_high_f32( samplex ), vget_low_f32( samplex ) );
+    return vget_lane_f32( vpadd_f32( half, half ), 0 );
+}
 #endif
 
+typedef int (*resampler_kernel)(resampler *, float **, float *);
+typedef void (*resampler_mc_kernel)(float *, const float *, int, const float *, int, int);
+typedef float (*resampler_dot_kernel)(const float *, const float *, int);
+
+typedef struct resampler_kernel_table
+{
+    resampler_kernel blep;
+    resampler_kernel cubic;
+    resampler_kernel sinc[SINC_WIDTH_COUNT];
+    resampler_mc_kernel mc_dot;
+    resampler_dot_kernel dot;
+} resampler_kernel_table;
+
 #ifdef RESAMPLER_NEON
-static int resampler_run_sinc(resampler * r, float ** out_, float * out_end)
+static resampler_kernel_table resampler_kernels = { resampler_run_blep, resampler_run_cubic, { resampler_run_sinc_8, resampler_run_sinc_16, resampler_run_sinc_32, resampler_run_sinc_64 }, resampler_mc_dot_neon, resampler_dot_neon };
+#else
+static resampler_kernel_table resampler_kernels = { resampler_run_blep, resampler_run_cubic, { resampler_run_sinc_8, resampler_run_sinc_16, resampler_run_sinc_32, resampler_run_sinc_64 }, resampler_mc_dot, resampler_dot };
+#endif
+
+static void resampler_select_kernels(void)
+{
+#ifdef RESAMPLER_SSE
+    if ( resampler_cpu_features & RESAMPLER_CPU_SSE2 )
+    {
+        resampler_iir_frames = iir_process_frames_sse2;
+        resampler_halfband_frames = resampler_halfband_sse;
+        resampler_convert_frames = resampler_convert_pcm_sse2;
+    }
+#endif
+#ifdef RESAMPLER_AVX
+    if ( resampler_cpu_features & RESAMPLER_CPU_AVX2 )
+    {
+        resampler_iir_frames = iir_process_frames_avx2;
+        resampler_halfband_frames = resampler_halfband_avx2;
+        resampler_convert_frames = resampler_convert_pcm_avx2;
+    }
+#endif
+#ifdef RESAMPLER_AVX
+    if ( resampler_cpu_features & RESAMPLER_CPU_AVX512 )
+    {
+        resampler_kernels.blep = resampler_run_blep_avx512;
+        resampler_kernels.cubic = resampler_run_cubic_avx512;
+        resampler_kernels.sinc[0] = resampler_run_sinc_avx512_8;
+        resampler_kernels.sinc[1] = resampler_run_sinc_avx512_16;
+        resampler_kernels.sinc[2] = resampler_run_sinc_avx512_32;
+        resampler_kernels.sinc[3] = resampler_run_sinc_avx512_64;
+        resampler_kernels.mc_dot = resampler_mc_dot_avx512;
+        resampler_kernels.dot = resampler_dot_avx512;
+        return;
+    }
+    if ( resampler_cpu_features & RESAMPLER_CPU_AVX2 )
+    {
+        resampler_kernels.blep = resampler_run_blep_avx2;
+        resampler_kernels.cubic = resampler_run_cubic_avx2;
+        resampler_kernels.sinc[0] = resampler_run_sinc_avx2_8;
+        resampler_kernels.sinc[1] = resampler_run_sinc_avx2_16;
+        resampler_kernels.sinc[2] = resampler_run_sinc_avx2_32;
+        resampler_kernels.sinc[3] = resampler_run_sinc_avx2_64;
+        resampler_kernels.mc_dot = resampler_mc_dot_avx2;
+        resampler_kernels.dot = resampler_dot_avx2;
+        return;
+    }
+#endif
+#ifdef RESAMPLER_SSE
+    if ( resampler_cpu_features & RESAMPLER_CPU_SSE )
+    {
+        resampler_kernels.blep = resampler_run_blep_sse;
+        resampler_kernels.cubic = resampler_run_cubic_sse;
+        resampler_kernels.sinc[0] = resampler_run_sinc_sse_8;
+        resampler_kernels.sinc[1] = resampler_run_sinc_sse_16;
+        resampler_kernels.sinc[2] = resampler_run_sinc_sse_32;
+        resampler_kernels.sinc[3] = resampler_run_sinc_sse_64;
+        resampler_kernels.mc_dot = resampler_mc_dot_sse;
+        resampler_kernels.dot = resampler_dot_sse;
+    }
+#endif
+}
+
+// Rational fast path for cubic and sinc: the bank holds the exact kernel
+// for every phase, so the loop only steps an integer phase index.
+static int resampler_run_rational(resampler * r, float ** out_, float * out_end)
 {
+    const int taps = resampler_rational_taps( r->quality, r->rational.width );
     int in_size = r->write_filled;
-    float const* in_ = r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    float const* in_ = r->buffer_in + r->buffer_size + r->write_pos - r->write_filled;
     int used = 0;
-    in_size -= SINC_WIDTH * 2;
+    in_size -= taps;
     if ( in_size > 0 )
     {
         float* out = *out_;
         float const* in = in_;
         float const* const in_end = in + in_size;
-        float phase = r->phase;
-        float phase_inc = r->phase_inc;
-        
-        int step = phase_inc > 1.0f ? (int)(RESAMPLER_RESOLUTION / phase_inc * RESAMPLER_SINC_CUTOFF) : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
-        int window_step = RESAMPLER_RESOLUTION;
-        
+        const unsigned int den = r->rational.den;
+        const int skip = r->rational.num / den;
+        const unsigned int rem = r->rational.num % den;
+        unsigned int index = resampler_rational_index( den, r->phase, r->phase_err );
+        float const* bank = r->rational.bank;
+        resampler_dot_kernel dot = resampler_kernels.dot;
+
         do
         {
-            // accumulate in extended precision
-            float kernel_sum = 0.0;
-            float32x4_t kernel[SINC_WIDTH / 2];
-            float32x4_t temp1, temp2;
-            float32x4_t samplex = {0};
-            float32x2_t half;
-            float *kernelf = (float*)(&kernel);
-            int i = SINC_WIDTH;
-            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
-            int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
-            
             if ( out >= out_end )
                 break;
-            
-            for (; i >= -SINC_WIDTH + 1; --i)
+
+            if ( taps == 4 )
             {
-                int pos = i * step;
-                int window_pos = i * window_step;
-                kernel_sum += kernelf[i + SINC_WIDTH - 1] = sinc_lut[abs(phase_adj - pos)] * window_lut[abs(phase_reduced - window_pos)];
+                float const* kernel = bank + index * 4;
+                *out++ = in[0] * kernel[0] + in[1] * kernel[1] + in[2] * kernel[2] + in[3] * kernel[3];
             }
-            for (i = 0; i < SINC_WIDTH / 2; ++i)
+            else
+                *out++ = dot( in, bank + index * taps, taps );
+
+            in += skip;
+            index += rem;
+            if ( index >= den )
             {
-                temp1 = vld1q_f32( (const float32_t *)( in + i * 4 ) );
-                temp2 = vld1q_f32( (const float32_t *)( kernel + i ) );
-                samplex = vmlaq_f32( samplex, temp1, temp2 );
+                index -= den;
+                ++in;
             }
-            kernel_sum = 1.0 / kernel_sum;
-            samplex = vmulq_f32(samplex, vmovq_n_f32(kernel_sum));
-            half = vadd_f32(vget_high_f32(samplex), vget_low_f32(samplex));
-            *out++ = vget_lane_f32(vpadd_f32(half, half), 0);
-            
-            phase += phase_inc;
-            
-            in += (int)phase;
-            
-            phase = fmod(phase, 1.0f);
         }
         while ( in < in_end );
-        
-        r->phase = phase;
+
+        r->phase = (unsigned int)( ( (unsigned long long)index << 32 ) / den );
+        r->phase_err = (unsigned int)( ( (unsigned long long)index << 32 ) % den );
         *out_ = out;
-        
+
         used = (int)(in - in_);
-        
+
         r->write_filled -= used;
     }
-    
-    return used;
+
+    return used;
+}
+
+static resampler_kernel resampler_run_kernel(resampler * r)
+{
+    if ( r->rational.bank )
+        return resampler_run_rational;
+
+    switch (r->quality)
+    {
+    default:
+    case RESAMPLER_QUALITY_ZOH:
+        return resampler_run_zoh;
+
+    case RESAMPLER_QUALITY_BLEP:
+        return resampler_kernels.blep;
+
+    case RESAMPLER_QUALITY_LINEAR:
+        return resampler_run_linear;
+
+    case RESAMPLER_QUALITY_BLAM:
+        return resampler_run_blam;
+
+    case RESAMPLER_QUALITY_CUBIC:
+        return resampler_kernels.cubic;
+
+    case RESAMPLER_QUALITY_SINC:
+        return resampler_kernels.sinc[resampler_sinc_width_index( r->sinc_width )];
+    }
+}
+
+// Runs a ramp one RESAMPLER_RAMP_CHUNK of output at a time, retuning the
+// ring between chunks, then carries on at the end factor.
+static int resampler_run_ramp(resampler * r, resampler_kernel kernel, float ** out_, float * out_end)
+{
+    // BLEP only emits while its whole kernel fits before out_end
+    const int tail = r->quality == RESAMPLER_QUALITY_BLEP ? SINC_WIDTH * 2 - 1 : 0;
+    int used = 0;
+    while ( r->ramp_pos < r->ramp_frames )
+    {
+        float * out = *out_;
+        float * chunk_end = out_end;
+        int chunk = RESAMPLER_RAMP_CHUNK - r->ramp_pos % RESAMPLER_RAMP_CHUNK;
+        if ( chunk > r->ramp_frames - r->ramp_pos )
+            chunk = r->ramp_frames - r->ramp_pos;
+        if ( out_end - out > chunk + tail )
+            chunk_end = out + chunk + tail;
+        resampler_ramp_step( r );
+        used += kernel( r, out_, chunk_end );
+        r->ramp_pos += (int)(*out_ - out);
+        if ( *out_ - out < chunk )
+            return used;
+    }
+    resampler_ramp_finish( r );
+    return used + kernel( r, out_, out_end );
+}
+
+static int resampler_run(resampler * r, float ** out_, float * out_end)
+{
+    resampler_kernel kernel = resampler_run_kernel( r );
+    if ( r->ramp_frames )
+        return resampler_run_ramp( r, kernel, out_, out_end );
+    return kernel( r, out_, out_end );
 }
-#endif
 
 static void resampler_fill(resampler * r)
 {
-    int min_filled = resampler_min_filled(r);
+    int min_filled = resampler_min_filled(r->quality, r->sinc_width);
     int quality = r->quality;
     while ( r->write_filled > min_filled &&
-            r->read_filled < resampler_buffer_size )
+            r->read_filled < r->buffer_size )
     {
-        int write_pos = ( r->read_pos + r->read_filled ) % resampler_buffer_size;
-        int write_size = resampler_buffer_size - write_pos;
+        int write_pos = ( r->read_pos + r->read_filled ) % r->buffer_size;
+        int write_size = r->buffer_size - write_pos;
         float * out = r->buffer_out + write_pos;
-        if ( write_size > ( resampler_buffer_size - r->read_filled ) )
-            write_size = resampler_buffer_size - r->read_filled;
-        switch (quality)
-        {
-        case RESAMPLER_QUALITY_ZOH:
-            resampler_run_zoh( r, &out, out + write_size );
-            break;
-                
-        case RESAMPLER_QUALITY_BLEP:
+        if ( write_size > ( r->buffer_size - r->read_filled ) )
+            write_size = r->buffer_size - r->read_filled;
+        if ( quality == RESAMPLER_QUALITY_BLEP )
         {
             int used;
             int write_extra = 0;
@@ -1270,45 +4032,14 @@ static void resampler_fill(resampler * r)
                 write_extra = r->read_pos;
             if ( write_extra > SINC_WIDTH * 2 - 1 )
                 write_extra = SINC_WIDTH * 2 - 1;
-            memcpy( r->buffer_out + resampler_buffer_size, r->buffer_out, write_extra * sizeof(r->buffer_out[0]) );
-#ifdef RESAMPLER_SSE
-            if ( resampler_has_sse )
-                used = resampler_run_blep_sse( r, &out, out + write_size + write_extra );
-            else
-#endif
-                used = resampler_run_blep( r, &out, out + write_size + write_extra );
-            memcpy( r->buffer_out, r->buffer_out + resampler_buffer_size, write_extra * sizeof(r->buffer_out[0]) );
+            memcpy( r->buffer_out + r->buffer_size, r->buffer_out, write_extra * sizeof(r->buffer_out[0]) );
+            used = resampler_run( r, &out, out + write_size + write_extra );
+            memcpy( r->buffer_out, r->buffer_out + r->buffer_size, write_extra * sizeof(r->buffer_out[0]) );
             if (!used)
                 return;
-            break;
-        }
-                
-        case RESAMPLER_QUALITY_LINEAR:
-            resampler_run_linear( r, &out, out + write_size );
-            break;
-                
-        case RESAMPLER_QUALITY_BLAM:
-            resampler_run_blam( r, &out, out + write_size );
-            break;
-
-        case RESAMPLER_QUALITY_CUBIC:
-#ifdef RESAMPLER_SSE
-            if ( resampler_has_sse )
-                resampler_run_cubic_sse( r, &out, out + write_size );
-            else
-#endif
-                resampler_run_cubic( r, &out, out + write_size );
-            break;
-                
-        case RESAMPLER_QUALITY_SINC:
-#ifdef RESAMPLER_SSE
-            if ( resampler_has_sse )
-                resampler_run_sinc_sse( r, &out, out + write_size );
-            else
-#endif
-                resampler_run_sinc( r, &out, out + write_size );
-            break;
         }
+        else
+            resampler_run( r, &out, out + write_size );
         r->read_filled += out - r->buffer_out - write_pos;
     }
 }
@@ -1317,18 +4048,19 @@ static void resampler_fill_and_remove_delay(resampler * r)
 {
     resampler_fill( r );
     if ( r->delay_removed < 0 )
-    {
-        int delay = resampler_output_delay( r );
         r->delay_removed = 0;
-        while ( delay-- )
-            resampler_remove_sample( r, 1 );
+    // the first fill may not produce the whole delay, so keep count until it has
+    while ( r->delay_removed < resampler_output_delay( r->quality ) && r->read_filled > 0 )
+    {
+        resampler_remove_sample( r, 1 );
+        ++r->delay_removed;
     }
 }
 
 int resampler_get_sample_count(void *_r)
 {
     resampler * r = ( resampler * ) _r;
-    if ( r->read_filled < 1 && (r->quality != RESAMPLER_QUALITY_BLEP || r->inv_phase_inc) )
+    if ( r->read_filled < 1 && (r->quality != RESAMPLER_QUALITY_BLEP || r->phase_inc) )
         resampler_fill_and_remove_delay( r );
     return r->read_filled;
 }
@@ -1376,6 +4108,516 @@ void resampler_remove_sample(void *_r, int decay)
             }
         }
         --r->read_filled;
-        r->read_pos = ( r->read_pos + 1 ) % resampler_buffer_size;
+        if ( ++r->read_pos == r->buffer_size )
+            r->read_pos = 0;
+    }
+}
+
+// Drains the output ring a contiguous span at a time. BLEP runs the same
+// decaying integration as resampler_remove_sample, carried in a register.
+static int resampler_read_ring_float(resampler * r, float * out, int count)
+{
+    int read = 0;
+    while ( read < count && r->read_filled > 0 )
+    {
+        float * in = r->buffer_out + r->read_pos;
+        int span = r->buffer_size - r->read_pos;
+        if ( span > r->read_filled )
+            span = r->read_filled;
+        if ( span > count - read )
+            span = count - read;
+        if ( r->quality == RESAMPLER_QUALITY_BLEP )
+        {
+            float accumulator = r->accumulator;
+            int i;
+            for ( i = 0; i < span; ++i )
+            {
+                out[read + i] = in[i] + accumulator;
+                accumulator += in[i];
+                accumulator -= accumulator * (1.0f / 8192.0f);
+                if (fabs(accumulator) < 1e-20f)
+                    accumulator = 0;
+            }
+            memset( in, 0, span * sizeof(float) );
+            r->accumulator = accumulator;
+        }
+        else
+            memcpy( out + read, in, span * sizeof(float) );
+        read += span;
+        r->read_filled -= span;
+        r->read_pos += span;
+        if ( r->read_pos == r->buffer_size )
+            r->read_pos = 0;
+    }
+    return read;
+}
+
+int resampler_read_float(void *_r, float * out, int count)
+{
+    resampler * r = ( resampler * ) _r;
+    int read = resampler_read_ring_float( r, out, count );
+
+    if ( r->quality == RESAMPLER_QUALITY_BLEP )
+    {
+        while ( read < count && r->phase_inc )
+        {
+            resampler_fill_and_remove_delay( r );
+            if ( r->read_filled < 1 )
+                break;
+            read += resampler_read_ring_float( r, out + read, count - read );
+        }
+    }
+    else if ( read < count && r->phase_inc && r->write_filled > resampler_min_filled( r->quality, r->sinc_width ) )
+    {
+        // no output delay to trim here, so the kernels can write straight out
+        float * out_ptr = out + read;
+        r->delay_removed = 0;
+        resampler_run( r, &out_ptr, out + count );
+        read = (int)(out_ptr - out);
+    }
+
+    return read;
+}
+
+void resampler_process_float(void *_r, const float * in, size_t in_count, size_t * in_used, float * out, size_t out_cap, size_t * out_made)
+{
+    resampler * r = ( resampler * ) _r;
+    size_t in_done = 0, out_done = 0;
+
+    for (;;)
+    {
+        size_t in_left = in_count - in_done, out_left = out_cap - out_done;
+        int written, made = 0;
+
+        // the writer stops at the free count, which is in input samples
+        if ( in_left > INT_MAX )
+            in_left = INT_MAX;
+        if ( out_left > INT_MAX )
+            out_left = INT_MAX;
+
+        // leftovers from the per-sample interface, or BLEP output, come first
+        out_done += resampler_read_ring_float( r, out + out_done, (int)out_left );
+        if ( out_done >= out_cap )
+            break;
+
+        written = resampler_write_block_float( r, in + in_done, (int)in_left );
+        in_done += written;
+
+        if ( r->quality == RESAMPLER_QUALITY_BLEP )
+        {
+            if ( r->phase_inc )
+                resampler_fill_and_remove_delay( r );
+            made = r->read_filled;
+        }
+        else if ( r->phase_inc && r->write_filled > resampler_min_filled( r->quality, r->sinc_width ) )
+        {
+            float * out_ptr = out + out_done;
+            r->delay_removed = 0;
+            resampler_run( r, &out_ptr, out + out_cap );
+            made = (int)(out_ptr - out - out_done);
+            out_done += made;
+        }
+
+        if ( !written && !made )
+            break;
+    }
+
+    if ( in_used )
+        *in_used = in_done;
+    if ( out_made )
+        *out_made = out_done;
+}
+
+typedef struct resampler_mc
+{
+    int channels;
+    int write_pos, write_filled;
+    unsigned int phase, phase_err;
+    double phase_inc;
+    resampler_step step;
+    unsigned char quality;
+    signed char delay_added;
+    unsigned char output_stage;
+    int sinc_bank_step;
+    float * sinc_bank;
+    resampler_rational rational;
+    float * buffer_in;
+    float * planar_out;
+    iir * filter;
+} resampler_mc;
+
+static int resampler_mc_update_sinc_bank(resampler_mc * r)
+{
+    int step = resampler_sinc_step( r->phase_inc, RESAMPLER_SINC_CUTOFF );
+    if ( !r->sinc_bank )
+    {
+        r->sinc_bank = ( float * ) resampler_aligned_malloc( SINC_BANK_SAMPLES * sizeof(float) );
+        if ( !r->sinc_bank ) return 0;
+        r->sinc_bank_step = -1;
+    }
+    if ( r->sinc_bank_step != step )
+    {
+        resampler_build_sinc_bank( r->sinc_bank, step, SINC_WIDTH, window_lut );
+        r->sinc_bank_step = step;
+    }
+    return 1;
+}
+
+void * resampler_mc_create(int channels)
+{
+    resampler_mc * r;
+    if ( channels < 1 ) return 0;
+    resampler_init();
+    r = ( resampler_mc * ) malloc( sizeof(resampler_mc) );
+    if ( !r ) return 0;
+
+    r->channels = channels;
+    r->write_pos = SINC_WIDTH - 1;
+    r->write_filled = 0;
+    r->phase = 0;
+    r->phase_err = 0;
+    r->phase_inc = 0;
+    resampler_step_set( &r->step, 0 );
+    r->quality = RESAMPLER_QUALITY_MAX;
+    r->delay_added = -1;
+    r->output_stage = 0;
+    r->sinc_bank_step = -1;
+    r->sinc_bank = 0;
+    r->rational.num = 0;
+    r->rational.den = 0;
+    r->rational.quality = -1;
+    r->rational.bank = 0;
+    r->buffer_in = ( float * ) resampler_aligned_malloc( resampler_buffer_size * 2 * channels * sizeof(float) );
+    r->planar_out = ( float * ) resampler_aligned_malloc( RESAMPLER_MC_PLANAR_FRAMES * channels * sizeof(float) );
+    r->filter = ( iir * ) calloc( channels * ( IIR_ORDER / 2 ), sizeof(iir) );
+
+    if ( !r->buffer_in || !r->planar_out || !r->filter || !resampler_mc_update_sinc_bank( r ) )
+    {
+        resampler_mc_delete( r );
+        return 0;
+    }
+
+    memset( r->buffer_in, 0, resampler_buffer_size * 2 * channels * sizeof(float) );
+
+    return r;
+}
+
+void resampler_mc_delete(void * _r)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    if ( !r ) return;
+    resampler_aligned_free( r->sinc_bank );
+    resampler_rational_free( &r->rational );
+    resampler_aligned_free( r->buffer_in );
+    resampler_aligned_free( r->planar_out );
+    free( r->filter );
+    free( r );
+}
+
+int resampler_mc_set_quality(void * _r, int quality)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    if (quality < RESAMPLER_QUALITY_MIN)
+        quality = RESAMPLER_QUALITY_MIN;
+    else if (quality > RESAMPLER_QUALITY_MAX)
+        quality = RESAMPLER_QUALITY_MAX;
+    // BLEP synthesizes its output by overlap-add, which this engine does not do
+    if (quality == RESAMPLER_QUALITY_BLEP)
+        return r->quality;
+    if ( r->quality != quality )
+    {
+        r->delay_added = -1;
+        if ( quality == RESAMPLER_QUALITY_SINC )
+        {
+            if ( !resampler_mc_update_sinc_bank( r ) )
+                quality = RESAMPLER_QUALITY_CUBIC;
+        }
+        else
+        {
+            resampler_aligned_free( r->sinc_bank );
+            r->sinc_bank = 0;
+            r->sinc_bank_step = -1;
+        }
+        if ( quality == RESAMPLER_QUALITY_BLAM && r->phase_inc )
+            r->output_stage = resampler_setup_blam( r->filter, r->channels, 1.0 / r->phase_inc );
+        resampler_rational_update( &r->rational, quality, SINC_WIDTH, &resampler_default_window, RESAMPLER_SINC_CUTOFF );
+    }
+    r->quality = (unsigned char)quality;
+    return quality;
+}
+
+static void resampler_mc_rate_changed(resampler_mc * r, double old_phase_inc)
+{
+    if (r->quality == RESAMPLER_QUALITY_BLAM && old_phase_inc != r->phase_inc)
+        r->output_stage = resampler_setup_blam( r->filter, r->channels, 1.0 / r->phase_inc );
+    if (r->quality == RESAMPLER_QUALITY_SINC)
+        resampler_mc_update_sinc_bank( r );
+    resampler_rational_update( &r->rational, r->quality, SINC_WIDTH, &resampler_default_window, RESAMPLER_SINC_CUTOFF );
+}
+
+void resampler_mc_set_rate(void * _r, double new_factor)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    double old_phase_inc = r->phase_inc;
+    if ( !resampler_factor_valid( new_factor ) ) return;
+    r->phase_inc = new_factor;
+    r->phase_err = 0;
+    r->rational.den = 0;
+    resampler_step_set( &r->step, new_factor );
+    resampler_mc_rate_changed( r, old_phase_inc );
+}
+
+void resampler_mc_set_rate_rational(void * _r, unsigned int num, unsigned int den)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    double old_phase_inc = r->phase_inc;
+    unsigned int gcd;
+    if ( !num || !den ) return;
+    gcd = resampler_gcd( num, den );
+    num /= gcd;
+    den /= gcd;
+    if ( num != r->rational.num || den != r->rational.den )
+        resampler_rational_free( &r->rational );
+    r->rational.num = num;
+    r->rational.den = den;
+    r->phase_inc = (double)num / den;
+    resampler_rational_snap( den, &r->phase, &r->phase_err );
+    resampler_step_set_rational( &r->step, num, den );
+    resampler_mc_rate_changed( r, old_phase_inc );
+}
+
+void resampler_mc_clear(void * _r)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    int c;
+    r->write_pos = SINC_WIDTH - 1;
+    r->write_filled = 0;
+    r->phase = 0;
+    r->phase_err = 0;
+    r->delay_added = -1;
+    memset( r->buffer_in, 0, (SINC_WIDTH - 1) * r->channels * sizeof(float) );
+    memset( r->buffer_in + resampler_buffer_size * r->channels, 0, (SINC_WIDTH - 1) * r->channels * sizeof(float) );
+    for (c = 0; c < r->channels * ( IIR_ORDER / 2 ); ++c)
+        iir_clear( r->filter + c );
+}
+
+void resampler_mc_clear_channel(void * _r, int channel)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    int i;
+    if ( channel < 0 || channel >= r->channels ) return;
+    for (i = 0; i < resampler_buffer_size * 2; ++i)
+        r->buffer_in[ i * r->channels + channel ] = 0;
+    for (i = 0; i < IIR_ORDER / 2; ++i)
+        iir_clear( r->filter + channel * ( IIR_ORDER / 2 ) + i );
+}
+
+// Takes interleaved frames from in, or, if planar is set, one array per
+// channel starting at planar[c][offset].
+static int resampler_mc_write_block_float(resampler_mc * r, const float * in, const float * const * planar, size_t offset, int count)
+{
+    const int channels = r->channels;
+    int free_count, written = 0;
+
+    if ( r->delay_added < 0 )
+    {
+        r->delay_added = 0;
+        r->write_filled = resampler_input_delay( r->quality, SINC_WIDTH );
+    }
+
+    free_count = resampler_buffer_size - r->write_filled;
+    if ( count > free_count )
+        count = free_count;
+
+    while ( written < count )
+    {
+        int i, c, span = resampler_buffer_size - r->write_pos;
+        float * out = r->buffer_in + r->write_pos * channels;
+
+        if ( span > count - written )
+            span = count - written;
+
+        if ( planar )
+        {
+            // transpose into the frame-major ring, one channel per lane
+            for (c = 0; c < channels; ++c)
+            {
+                const float * src = planar[c] + offset + written;
+                for (i = 0; i < span; ++i)
+                    out[i * channels + c] = src[i] + 1e-25;
+            }
+        }
+        else
+        {
+            for (i = 0; i < span * channels; ++i)
+                out[i] = in[i] + 1e-25;
+            in += span * channels;
+        }
+
+        if ( r->quality == RESAMPLER_QUALITY_BLAM && !r->output_stage )
+            resampler_iir_frames( r->filter, out, span, channels, channels );
+
+        memcpy( out + resampler_buffer_size * channels, out, span * channels * sizeof(float) );
+
+        written += span;
+        r->write_filled += span;
+        r->write_pos = ( r->write_pos + span ) % resampler_buffer_size;
+    }
+
+    return written;
+}
+
+// Computes the kernel once per output frame and applies it to every channel.
+static int resampler_mc_run(resampler_mc * r, float * out, int out_frames)
+{
+    const int channels = r->channels;
+    const int quality = r->quality;
+    int in_size = r->write_filled - resampler_min_filled( quality, SINC_WIDTH );
+    float const* in_ = r->buffer_in + ( resampler_buffer_size + r->write_pos - r->write_filled ) * channels;
+    int made = 0;
+    if ( in_size > 0 && out_frames > 0 )
+    {
+        ALIGNED float kernel[SINC_WIDTH * 2];
+        float const* in = in_;
+        float const* const in_end = in + in_size * channels;
+        unsigned int phase = r->phase;
+        unsigned int phase_err = r->phase_err;
+        const resampler_step step = r->step;
+        resampler_mc_kernel dot = resampler_kernels.mc_dot;
+        float const* rational_bank = r->rational.bank;
+        const unsigned int rational_den = r->rational.den;
+
+        do
+        {
+            float * frame = out + made * channels;
+
+            switch (quality)
+            {
+            default:
+            case RESAMPLER_QUALITY_ZOH:
+                memcpy( frame, in, channels * sizeof(float) );
+                break;
+
+            case RESAMPLER_QUALITY_LINEAR:
+            case RESAMPLER_QUALITY_BLAM:
+                kernel[1] = PHASE_TO_FLOAT(phase);
+                kernel[0] = 1.0f - kernel[1];
+                dot( frame, in, channels, kernel, 2, channels );
+                break;
+
+            case RESAMPLER_QUALITY_CUBIC:
+                if ( rational_bank )
+                    dot( frame, in, channels, rational_bank + resampler_rational_index( rational_den, phase, phase_err ) * 4, 4, channels );
+                else
+                    dot( frame, in, channels, cubic_lut + (phase >> (32 - RESAMPLER_SHIFT)) * 4, 4, channels );
+                break;
+
+            case RESAMPLER_QUALITY_SINC:
+                if ( rational_bank )
+                {
+                    dot( frame, in, channels, rational_bank + resampler_rational_index( rational_den, phase, phase_err ) * SINC_WIDTH * 2, SINC_WIDTH * 2, channels );
+                    break;
+                }
+            {
+                float phase_frac = PHASE_TO_FLOAT(phase << SINC_PHASE_SHIFT);
+                float const* kernel0 = r->sinc_bank + (phase >> (32 - SINC_PHASE_SHIFT)) * SINC_WIDTH * 2;
+                float const* kernel1 = kernel0 + SINC_WIDTH * 2;
+                int i;
+                for (i = 0; i < SINC_WIDTH * 2; ++i)
+                    kernel[i] = kernel0[i] + (kernel1[i] - kernel0[i]) * phase_frac;
+                dot( frame, in, channels, kernel, SINC_WIDTH * 2, channels );
+                break;
+            }
+            }
+            ++made;
+
+            in += resampler_step_advance( &step, &phase, &phase_err ) * channels;
+        }
+        while ( in < in_end && made < out_frames );
+
+        r->phase = phase;
+        r->phase_err = phase_err;
+        r->write_filled -= (int)(in - in_) / channels;
+
+        if ( quality == RESAMPLER_QUALITY_BLAM && r->output_stage )
+            resampler_iir_frames( r->filter, out, made, channels, channels );
+    }
+
+    return made;
+}
+
+void resampler_mc_process_float(void * _r, const float * in, size_t in_frames, size_t * in_used, float * out, size_t out_frames, size_t * out_made)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    size_t in_done = 0, out_done = 0;
+
+    while ( out_done < out_frames )
+    {
+        size_t in_left = in_frames - in_done, out_left = out_frames - out_done;
+        int written, made = 0;
+
+        if ( in_left > resampler_buffer_size )
+            in_left = resampler_buffer_size;
+        if ( out_left > INT_MAX )
+            out_left = INT_MAX;
+
+        written = resampler_mc_write_block_float( r, in + in_done * r->channels, 0, 0, (int)in_left );
+        in_done += written;
+
+        if ( r->phase_inc )
+        {
+            made = resampler_mc_run( r, out + out_done * r->channels, (int)out_left );
+            out_done += made;
+        }
+
+        if ( !written && !made )
+            break;
+    }
+
+    if ( in_used )
+        *in_used = in_done;
+    if ( out_made )
+        *out_made = out_done;
+}
+
+void resampler_mc_process_planar_float(void * _r, const float * const * in, size_t in_frames, size_t * in_used, float * const * out, size_t out_frames, size_t * out_made)
+{
+    resampler_mc * r = ( resampler_mc * ) _r;
+    const int channels = r->channels;
+    size_t in_done = 0, out_done = 0;
+
+    while ( out_done < out_frames )
+    {
+        size_t in_left = in_frames - in_done, out_left = out_frames - out_done;
+        int written, made = 0;
+
+        if ( in_left > resampler_buffer_size )
+            in_left = resampler_buffer_size;
+        if ( out_left > RESAMPLER_MC_PLANAR_FRAMES )
+            out_left = RESAMPLER_MC_PLANAR_FRAMES;
+
+        written = resampler_mc_write_block_float( r, 0, in, in_done, (int)in_left );
+        in_done += written;
+
+        if ( r->phase_inc )
+        {
+            int i, c;
+            made = resampler_mc_run( r, r->planar_out, (int)out_left );
+            for (c = 0; c < channels; ++c)
+            {
+                float * dst = out[c] + out_done;
+                for (i = 0; i < made; ++i)
+                    dst[i] = r->planar_out[i * channels + c];
+            }
+            out_done += made;
+        }
+
+        if ( !written && !made )
+            break;
     }
+
+    if ( in_used )
+        *in_used = in_done;
+    if ( out_made )
+        *out_made = out_done;
 }
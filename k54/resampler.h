@@ -8,35 +8,101 @@
 #define EVALUATE(a,b) PASTE(a,b)
 #define resampler_init EVALUATE(RESAMPLER_DECORATE,_resampler_init)
 #define resampler_create EVALUATE(RESAMPLER_DECORATE,_resampler_create)
+#define resampler_create_ex EVALUATE(RESAMPLER_DECORATE,_resampler_create_ex)
 #define resampler_delete EVALUATE(RESAMPLER_DECORATE,_resampler_delete)
 #define resampler_dup EVALUATE(RESAMPLER_DECORATE,_resampler_dup)
 #define resampler_dup_inplace EVALUATE(RESAMPLER_DECORATE,_resampler_dup_inplace)
+#define resampler_pool_create EVALUATE(RESAMPLER_DECORATE,_resampler_pool_create)
+#define resampler_pool_delete EVALUATE(RESAMPLER_DECORATE,_resampler_pool_delete)
+#define resampler_pool_acquire EVALUATE(RESAMPLER_DECORATE,_resampler_pool_acquire)
+#define resampler_get_state_size EVALUATE(RESAMPLER_DECORATE,_resampler_get_state_size)
+#define resampler_save_state EVALUATE(RESAMPLER_DECORATE,_resampler_save_state)
+#define resampler_load_state EVALUATE(RESAMPLER_DECORATE,_resampler_load_state)
 #define resampler_set_quality EVALUATE(RESAMPLER_DECORATE,_resampler_set_quality)
+#define resampler_set_sinc_width EVALUATE(RESAMPLER_DECORATE,_resampler_set_sinc_width)
+#define resampler_set_filter EVALUATE(RESAMPLER_DECORATE,_resampler_set_filter)
 #define resampler_get_free_count EVALUATE(RESAMPLER_DECORATE,_resampler_get_free_count)
 #define resampler_get_padding_size EVALUATE(RESAMPLER_DECORATE,_resampler_get_padding_size)
 #define resampler_write_sample EVALUATE(RESAMPLER_DECORATE,_resampler_write_sample)
 #define resampler_write_sample_fixed EVALUATE(RESAMPLER_DECORATE,_resampler_write_sample_fixed)
 #define resampler_Write_sample_float EVALUATE(RESAMPLER_DECORATE,_resampler_write_sample_float)
+#define resampler_write_block_s16 EVALUATE(RESAMPLER_DECORATE,_resampler_write_block_s16)
+#define resampler_write_block_s24 EVALUATE(RESAMPLER_DECORATE,_resampler_write_block_s24)
+#define resampler_write_block_s32 EVALUATE(RESAMPLER_DECORATE,_resampler_write_block_s32)
 #define resampler_set_rate EVALUATE(RESAMPLER_DECORATE,_resampler_set_rate)
+#define resampler_set_rate_rational EVALUATE(RESAMPLER_DECORATE,_resampler_set_rate_rational)
+#define resampler_set_rate_ramp EVALUATE(RESAMPLER_DECORATE,_resampler_set_rate_ramp)
 #define resampler_ready EVALUATE(RESAMPLER_DECORATE,_resampler_ready)
 #define resampler_clear EVALUATE(RESAMPLER_DECORATE,_resampler_clear)
 #define resampler_get_sample_count EVALUATE(RESAMPLER_DECORATE,_resampler_get_sample_count)
 #define resampler_get_sample EVALUATE(RESAMPLER_DECORATE,_resampler_get_sample)
 #define resampler_get_sample_float EVALUATE(RESAMPLER_DECORATE,_resampler_get_sample_float)
 #define resampler_remove_sample EVALUATE(RESAMPLER_DECORATE,_resampler_remove_sample)
+#define resampler_read_float EVALUATE(RESAMPLER_DECORATE,_resampler_read_float)
+#define resampler_process_float EVALUATE(RESAMPLER_DECORATE,_resampler_process_float)
+#define resampler_mc_create EVALUATE(RESAMPLER_DECORATE,_resampler_mc_create)
+#define resampler_mc_delete EVALUATE(RESAMPLER_DECORATE,_resampler_mc_delete)
+#define resampler_mc_set_quality EVALUATE(RESAMPLER_DECORATE,_resampler_mc_set_quality)
+#define resampler_mc_set_rate EVALUATE(RESAMPLER_DECORATE,_resampler_mc_set_rate)
+#define resampler_mc_set_rate_rational EVALUATE(RESAMPLER_DECORATE,_resampler_mc_set_rate_rational)
+#define resampler_mc_clear EVALUATE(RESAMPLER_DECORATE,_resampler_mc_clear)
+#define resampler_mc_clear_channel EVALUATE(RESAMPLER_DECORATE,_resampler_mc_clear_channel)
+#define resampler_mc_process_float EVALUATE(RESAMPLER_DECORATE,_resampler_mc_process_float)
+#define resampler_mc_process_planar_float EVALUATE(RESAMPLER_DECORATE,_resampler_mc_process_planar_float)
 #endif
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Builds the shared tables and picks the kernels for this CPU. It runs at
+// most once per process and is safe to call from any thread; the create
+// functions call it themselves, so calling it up front is optional.
 void resampler_init(void);
 
 void * resampler_create(void);
+// Sizes the input and output rings to buffer_frames samples each, clamped
+// to at least the default of 128. Larger rings let block callers process
+// more samples per kernel call, at the cost of more buffered latency for
+// callers that fill until resampler_get_free_count() reaches zero.
+void * resampler_create_ex(size_t buffer_frames);
 void resampler_delete(void *);
 void * resampler_dup(const void *);
+// If the buffer sizes differ and the destination cannot be resized, it is
+// left unchanged.
 void resampler_dup_inplace(void *, const void *);
 
+// Instance pools, for callers that start and stop streams on the audio
+// thread. resampler_pool_create() builds count instances with
+// buffer_frames rings up front. resampler_pool_acquire() hands out one,
+// or 0 when all are in use, and resampler_delete() gives it back. Acquire
+// clears the stream but keeps the settings of the instance's last user,
+// or the resampler_create_ex() defaults for a fresh one, together with
+// the tables, banks and decimator built for them. A ramp in progress
+// stops at the factor it has reached. Neither acquire nor delete
+// allocates, frees or locks. Settings made after acquire cost what they
+// do outside a pool: nothing is rebuilt when they match what the
+// instance already has. The pool is not locked: acquire and delete its
+// instances from one thread at a time, and delete them all before the
+// pool.
+void * resampler_pool_create(int count, size_t buffer_frames);
+void resampler_pool_delete(void *);
+void * resampler_pool_acquire(void *);
+
+// Checkpoint and migration. resampler_save_state() stores the complete
+// stream state, resampler_get_state_size() bytes, and returns the bytes
+// written, or 0 if size is too small. A decimating rate adds the decimator
+// to the state, so ask for the size after setting the rate.
+// resampler_load_state() restores it into any resampler, which then
+// continues sample for sample where the saved one left off. It returns 0,
+// leaving the target unchanged, if the data is not a state from this
+// version and ABI or cannot be allocated.
+size_t resampler_get_state_size(const void *);
+size_t resampler_save_state(const void *, void * data, size_t size);
+int resampler_load_state(void *, const void * data, size_t size);
+
 enum
 {
     RESAMPLER_QUALITY_MIN = 0,
@@ -50,19 +116,98 @@ enum
 };
 
 void resampler_set_quality(void *, int quality);
+// Taps per side of the SINC kernel: 8, 16, 32 (the default) or 64, rounded
+// up to the next of these. Narrower kernels are cheaper with a wider
+// transition band. Rings smaller than four times the width are grown, which
+// clears the resampler; buffered input is dropped as on a quality change.
+void resampler_set_sinc_width(void *, int width);
+
+enum
+{
+    RESAMPLER_WINDOW_NUTTALL = 0,
+    RESAMPLER_WINDOW_BLACKMAN = 1,
+    RESAMPLER_WINDOW_HELMRICH = 2,
+    RESAMPLER_WINDOW_LANCZOS = 3,
+    RESAMPLER_WINDOW_KAISER = 4
+};
+
+// Filter design for SINC and BLEP. cutoff is the -6 dB point as a fraction
+// of the lower Nyquist frequency, or 0 for the defaults of 0.999 (SINC)
+// and 0.90 (BLEP). The Kaiser window takes kaiser_beta, or with 0 derives
+// it from transition_width, also a fraction of Nyquist, and the sinc
+// width; with neither it uses a beta of 8.6. The defaults are Nuttall and
+// 0. Window tables and sinc banks are cached and shared between all
+// instances with the same design, so many streams on one profile touch
+// one copy. The half-band decimator keeps its own fixed design.
+void resampler_set_filter(void *, int window, double kaiser_beta, double cutoff, double transition_width);
 
 int resampler_get_free_count(void *);
 int resampler_get_padding_size();
 void resampler_write_sample(void *, short sample);
 void resampler_write_sample_fixed(void *, int sample, unsigned char depth);
 void resampler_write_sample_float(void *, float sample);
+// Block forms of the integer writers: they take up to count samples, stop
+// at resampler_get_free_count(), and return how many were taken. s16 is
+// scaled like resampler_write_sample, s24 (packed little-endian, three
+// bytes a sample) and s32 like resampler_write_sample_fixed with depth 24
+// or the given depth.
+int resampler_write_block_s16(void *, const short * in, int count);
+int resampler_write_block_s24(void *, const unsigned char * in, int count);
+int resampler_write_block_s32(void *, const int * in, int count, unsigned char depth);
+// Factors of 4 and up with BLAM, CUBIC or SINC first decimate the input
+// through 2:1 half-band stages, so the interpolator works at a factor
+// between 2 and 4 whatever the overall ratio. resampler_get_free_count()
+// stays in input samples. A factor outside 2^-32 to 2^32, or one that is
+// not a number, is ignored; the same goes for the ramp and mc setters.
 void resampler_set_rate( void *, double new_factor );
+// Exact rational factor num / den (input rate / output rate). The phase
+// never drifts, so after den output samples exactly num inputs are used.
+void resampler_set_rate_rational( void *, unsigned int num, unsigned int den );
+// Glides the factor from start_factor to end_factor over the next frames
+// output samples, then holds end_factor. The ring is retuned every 16
+// outputs, and BLAM retunes its filter from a table instead of
+// recomputing it. SINC keeps the filter of the larger factor for the
+// length of the ramp. The decimator is sized for the smaller of the two
+// factors and keeps that size after the ramp ends, since changing it
+// mid-stream steps the output. A later resampler_set_rate(end_factor)
+// sizes it for end_factor. Any other rate call cancels the ramp.
+void resampler_set_rate_ramp( void *, double start_factor, double end_factor, int frames );
 int resampler_ready(void *);
 void resampler_clear(void *);
 int resampler_get_sample_count(void *);
 int resampler_get_sample(void *);
 float resampler_get_sample_float(void *);
 void resampler_remove_sample(void *, int decay);
+// Copies up to count output samples into out and removes them, returning
+// how many were available. Equivalent to the get_sample_count /
+// get_sample_float / remove_sample loop with decay enabled.
+int resampler_read_float(void *, float * out, int count);
+
+// Block interface: consumes up to in_count samples from in and produces up
+// to out_cap samples into out, running the interpolation kernels straight
+// into the caller's buffer. Either count may be zero. The number of samples
+// actually consumed and produced is returned through in_used and out_made.
+void resampler_process_float(void *, const float * in, size_t in_count, size_t * in_used, float * out, size_t out_cap, size_t * out_made);
+
+// Multichannel resampler taking and producing interleaved frames. Phase and
+// kernel are computed once per output frame and shared by all channels.
+// Supports every quality except BLEP. resampler_mc_set_quality() returns
+// the quality in effect afterwards: BLEP is refused and leaves the current
+// quality, and SINC falls back to CUBIC if its bank cannot be allocated.
+void * resampler_mc_create(int channels);
+void resampler_mc_delete(void *);
+int resampler_mc_set_quality(void *, int quality);
+void resampler_mc_set_rate(void *, double new_factor);
+void resampler_mc_set_rate_rational(void *, unsigned int num, unsigned int den);
+void resampler_mc_clear(void *);
+void resampler_mc_process_float(void *, const float * in, size_t in_frames, size_t * in_used, float * out, size_t out_frames, size_t * out_made);
+
+// Batch form of the above for many independent mono voices at one ratio:
+// in[c] and out[c] are per-voice arrays. History is kept frame-major, so
+// the kernels run across voices in SIMD lanes. clear_channel resets a
+// single voice's history and filter state, e.g. when a voice is recycled.
+void resampler_mc_process_planar_float(void *, const float * const * in, size_t in_frames, size_t * in_used, float * const * out, size_t out_frames, size_t * out_made);
+void resampler_mc_clear_channel(void *, int channel);
 
 #ifdef __cplusplus
 }
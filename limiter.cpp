@@ -1,6 +1,11 @@
 #include <math.h>
 #include <string.h>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LIMITER_SSE
+#endif
+
 #include "limiter.h"
 
 namespace monkee_limiter
@@ -13,40 +18,113 @@ static inline float f_max(float v1,float v2)
 
 static const float limiter_max = (float)0.9999;
 
+// index of the first sample louder than limiter_max, or count; the
+// samples before it are folded into *level
+static int scan_quiet(const float * in, int count, float * level)
+{
+	int i = 0;
+	float peak = *level;
+#ifdef LIMITER_SSE
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 threshold = _mm_set1_ps(limiter_max);
+	__m128 acc = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 val = _mm_andnot_ps(sign, _mm_loadu_ps(in + i));
+		if (_mm_movemask_ps(_mm_cmpgt_ps(val, threshold))) break;
+		acc = _mm_max_ps(acc, val);
+	}
+	acc = _mm_max_ps(acc, _mm_movehl_ps(acc, acc));
+	acc = _mm_max_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+	peak = f_max(peak, _mm_cvtss_f32(acc));
+#endif
+	for (; i < count; ++i)
+	{
+		float val = (float)fabs(in[i]);
+		if (val > limiter_max) break;
+		peak = f_max(peak, val);
+	}
+	*level = peak;
+	return i;
+}
+
+// index of the first nonzero peak from i on, or count
+static int idle_end(const float * peak, int i, int count)
+{
+#ifdef LIMITER_SSE
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+		if (_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(peak + i), zero))) break;
+#endif
+	for (; i < count; ++i)
+		if (peak[i]) break;
+	return i;
+}
+
+// out *= level over count samples
+static void scale(float * out, int count, float level)
+{
+	int i = 0;
+#ifdef LIMITER_SSE
+	const __m128 vlevel = _mm_set1_ps(level);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(out + i), vlevel));
+#endif
+	for (; i < count; ++i)
+		out[i] = out[i] * level;
+}
+
 limiter::limiter()
 {
 	bufPos = 0;
+	memset(backbuffer,0,sizeof(backbuffer));
+	memset(suffix,0,sizeof(suffix));
+	prefix = 0.0f;
+	suffixValid = false;
     gain		= 1.0f,
 	minGainLP	= 1.0f;
     active = false;
 }
 
+// The maximum of |in| over the lookahead window ending at ring position
+// pos, van Herk/Gil-Werman style: the window is the current pass up to pos
+// plus the previous pass after it. The previous pass is still in backbuffer
+// past pos, so its suffix maxima are built on first use in each pass.
+float limiter::window_max(int pos)
+{
+	if (!suffixValid)
+	{
+		float val = 0.0f;
+		for (int n = bufMax; n > pos; --n)
+		{
+			val = f_max(val,(float)fabs(backbuffer[n]));
+			suffix[n] = val;
+		}
+		suffixValid = true;
+	}
+	return f_max(prefix,suffix[pos+1]);
+}
+
 float limiter::process_sample(float in)
 {
-    float max,out;
+    float max = 0.0f, out;
 
 	float val = (float)fabs(in);
-		
-    if (val > limiter_max)
+
+    if (bufPos == 0)
     {
-        if (!active) memset(buffer,0,sizeof(buffer));
-        active = true;
+        prefix = 0.0f;
+        suffixValid = false;
     }
+    prefix = f_max(prefix,val);
 
+    // while idle the window holds nothing over the threshold, so only a
+    // loud sample can start it
     {
-        if (active)
+        if (active || val > limiter_max)
         {
-            int offset = bufPos, level = bufPow;
-            do
-            {
-                float * ptr = buffer + bufLength*2 - (2<<level);
-				ptr[offset]=val;
-                val = f_max(val,ptr[offset^1]);
-                offset>>=1;
-                level--;
-            } while(level>0);
-            max = val;
-            if (max<=limiter_max) active = false;
+            max = window_max(bufPos);
+            active = max > limiter_max;
         }
 			
 
@@ -76,4 +154,92 @@ float limiter::process_sample(float in)
     return out * gain;
 }
 
+// The peak of the lookahead window for each sample, or 0 where the limiter
+// is idle. count must not run past the end of the ring. Idle stretches are
+// skipped with a vector scan for the next sample over the threshold.
+void limiter::scan_peaks(const float * in, float * peak, int count)
+{
+	int i = 0;
+	if (bufPos == 0)
+	{
+		prefix = 0.0f;
+		suffixValid = false;
+	}
+	while (i < count)
+	{
+		float val;
+		if (!active)
+		{
+			int skip = scan_quiet(in + i, count - i, &prefix);
+			memset(peak + i, 0, skip * sizeof(float));
+			i += skip;
+			if (i == count) break;
+		}
+
+		prefix = f_max(prefix,(float)fabs(in[i]));
+		val = window_max(bufPos + i);
+		active = val > limiter_max;
+		peak[i++] = active ? val : 0.0f;
+	}
+}
+
+void limiter::process_block(const float * in, float * out, size_t count)
+{
+	float peak[bufLength];
+	float tail[bufLength];
+
+	while (count)
+	{
+		int n = count < (size_t)(bufLength - bufPos) ? (int)count : bufLength - bufPos;
+		int delayed = n < bufMax ? n : bufMax;
+		int first, i;
+
+		// everything that needs the input comes before out is written,
+		// since out may be in
+		scan_peaks(in, peak, n);
+		memcpy(tail, in, n * sizeof(float));
+
+		// the delay line: the first bufMax outputs come from backbuffer,
+		// the rest are this block's input moved down
+		memmove(out + delayed, in, (n - delayed) * sizeof(float));
+		first = bufLength - ((bufPos + 1) & bufMax);
+		if (first > delayed) first = delayed;
+		memcpy(out, backbuffer + ((bufPos + 1) & bufMax), first * sizeof(float));
+		memcpy(out + first, backbuffer, (delayed - first) * sizeof(float));
+
+		memcpy(backbuffer + bufPos, tail, n * sizeof(float));
+		bufPos = (bufPos + n) & bufMax;
+
+		for (i = 0; i < n; ++i)
+		{
+			float minGain = peak[i] ? limiter_max/peak[i] : limiter_max;
+			float sample = out[i];
+			float lastLP = minGainLP, lastGain = gain;
+			int end;
+
+			minGainLP = 0.9f*minGainLP + 0.1f * minGain;
+
+			gain = 0.001f + 0.999f*gain;
+			if (minGainLP<gain) gain = minGainLP;
+
+			if (fabs(sample*gain)>limiter_max) gain = (float)(limiter_max/fabs(sample));
+
+			out[i] = sample * gain;
+
+			// An idle step that leaves the envelope unchanged has reached its
+			// fixed point, so the rest of the idle run only scales the delayed
+			// input. Idle means the delayed sample is within the window and
+			// under the threshold, so the clip check cannot fire either.
+			if (peak[i] || minGainLP != lastLP || gain != lastGain) continue;
+			end = idle_end(peak, i + 1, n);
+			scale(out + i + 1, end - i - 1, gain);
+			i = end - 1;
+		}
+
+		in += n;
+		out += n;
+		count -= n;
+	}
+}
+
 }
@@ -1,6 +1,8 @@
 #ifndef _limiter_h_
 #define _limiter_h_
 
+#include <stddef.h>
+
 namespace monkee_limiter
 {
 
@@ -17,7 +19,11 @@ class limiter
 
 	float backbuffer[bufLength];
 
-	float buffer[bufLength*2];
+	// sliding maximum of |in| over the lookahead: suffix maxima of the
+	// previous ring pass and a running maximum of the current one
+	float suffix[bufLength+1];
+	float prefix;
+	bool suffixValid;
 	
 	float gain,minGainLP;
 
@@ -27,6 +33,14 @@ public:
 	limiter();
 
 	float process_sample(float in);
+
+	// Same output as process_sample on each sample in turn. out may equal
+	// in; other overlaps are not allowed.
+	void process_block(const float * in, float * out, size_t count);
+
+private:
+	float window_max(int pos);
+	void scan_peaks(const float * in, float * peak, int count);
 };
 
 }
@@ -1,9 +1,11 @@
 #pragma once
 
 //transposed direct form II biquadratic second-order IIR filter
+//T is the sample type; coefficients are designed in double precision
 
 namespace nall { namespace DSP { namespace IIR {
 
+template<typename T = double>
 struct Biquad {
   enum class Type : uint {
     LowPass,
@@ -16,20 +18,29 @@ struct Biquad {
   };
 
   inline auto reset(Type type, double cutoff, double quality, double gain = 0.0) -> void;
-  inline auto process(double in) -> double;  //normalized sample (-1.0 to +1.0)
+  inline auto process(T in) -> T;  //normalized sample (-1.0 to +1.0)
+  inline auto process(const T* input, T* output, uint length) -> void;  //input may equal output
+  //one sample on each of lanes channels through these coefficients, with the
+  //state of lane n in z1[n] and z2[n]; runs across the lanes in parallel
+  inline auto process(T* samples, T* z1, T* z2, uint lanes) const -> void;
+
+  //runs count filters in series over a block, one filter at a time
+  inline static auto cascade(Biquad* filters, uint count, const T* input, T* output, uint length) -> void;
 
   inline static auto butterworth(uint order, uint phase) -> double;
 
+  inline auto serialize(serializer&) -> void;
+
 private:
   Type type;                  //filter type
   double cutoff;              //frequency cutoff
   double quality;             //frequency response quality
   double gain;                //peak gain
-  double a0, a1, a2, b1, b2;  //coefficients
-  double z1, z2;              //second-order IIR
+  T a0, a1, a2, b1, b2;       //coefficients
+  T z1, z2;                   //second-order IIR
 };
 
-auto Biquad::reset(Type type, double cutoff, double quality, double gain) -> void {
+template<typename T> auto Biquad<T>::reset(Type type, double cutoff, double quality, double gain) -> void {
   this->type = type;
   this->cutoff = cutoff;
   this->quality = quality;
@@ -42,6 +53,7 @@ auto Biquad::reset(Type type, double cutoff, double quality, double gain) -> voi
   double k = tan(Math::Pi * cutoff);
   double q = quality;
   double n = 0.0;
+  double a0, a1, a2, b1, b2;
 
   switch(type) {
 
@@ -136,17 +148,74 @@ auto Biquad::reset(Type type, double cutoff, double quality, double gain) -> voi
     break;
 
   }
+
+  this->a0 = a0;
+  this->a1 = a1;
+  this->a2 = a2;
+  this->b1 = b1;
+  this->b2 = b2;
 }
 
-auto Biquad::process(double in) -> double {
-  double out = in * a0 + z1;
+template<typename T> auto Biquad<T>::process(T in) -> T {
+  T out = in * a0 + z1;
   z1 = in * a1 + z2 - b1 * out;
   z2 = in * a2 - b2 * out;
   return out;
 }
 
+//the state lives in locals for the whole block, so it stays in registers
+template<typename T> auto Biquad<T>::process(const T* input, T* output, uint length) -> void {
+  const T a0 = this->a0, a1 = this->a1, a2 = this->a2, b1 = this->b1, b2 = this->b2;
+  T z1 = this->z1, z2 = this->z2;
+  for(uint n : range(length)) {
+    T in = input[n];
+    T out = in * a0 + z1;
+    z1 = in * a1 + z2 - b1 * out;
+    z2 = in * a2 - b2 * out;
+    output[n] = out;
+  }
+  this->z1 = z1;
+  this->z2 = z2;
+}
+
+template<typename T> auto Biquad<T>::process(T* samples, T* z1, T* z2, uint lanes) const -> void {
+  const T a0 = this->a0, a1 = this->a1, a2 = this->a2, b1 = this->b1, b2 = this->b2;
+  for(uint n : range(lanes)) {
+    T in = samples[n];
+    T out = in * a0 + z1[n];
+    z1[n] = in * a1 + z2[n] - b1 * out;
+    z2[n] = in * a2 - b2 * out;
+    samples[n] = out;
+  }
+}
+
+template<typename T> auto Biquad<T>::cascade(Biquad* filters, uint count, const T* input, T* output, uint length) -> void {
+  if(!count) {
+    if(input != output) memory::copy(output, input, length * sizeof(T));
+    return;
+  }
+  filters[0].process(input, output, length);
+  for(uint n = 1; n < count; n++) filters[n].process(output, output, length);
+}
+
+template<typename T> auto Biquad<T>::serialize(serializer& s) -> void {
+  uint filterType = (uint)type;
+  s.integer(filterType);
+  type = (Type)filterType;
+  s.floatingpoint(cutoff);
+  s.floatingpoint(quality);
+  s.floatingpoint(gain);
+  s.floatingpoint(a0);
+  s.floatingpoint(a1);
+  s.floatingpoint(a2);
+  s.floatingpoint(b1);
+  s.floatingpoint(b2);
+  s.floatingpoint(z1);
+  s.floatingpoint(z2);
+}
+
 //compute Q values for N-order butterworth filtering
-auto Biquad::butterworth(uint order, uint phase) -> double {
+template<typename T> auto Biquad<T>::butterworth(uint order, uint phase) -> double {
   return -0.5 / cos(Math::Pi / 2.0 * (1.0 + (1.0 + (2.0 * phase + 1.0) / order)));
 }
 
@@ -0,0 +1,136 @@
+#pragma once
+
+//four point Hermite interpolating resampler, zero tension and bias
+//T is the sample type; write() and read() take single samples or blocks
+
+#include <nall/queue.hpp>
+#include <nall/serializer.hpp>
+
+namespace nall { namespace DSP { namespace Resampler {
+
+template<typename T = double>
+struct Hermite {
+  inline auto inputFrequency() const -> double { return _inputFrequency; }
+  inline auto outputFrequency() const -> double { return _outputFrequency; }
+
+  //the queue holds queueSize output samples, 20ms by default, and never less
+  //than one input can produce. A block write stops at the first input whose
+  //output the queue could not hold; it returns how many inputs it took.
+  inline auto reset(double inputFrequency, double outputFrequency = 0, uint queueSize = 0) -> void;
+  inline auto setInputFrequency(double inputFrequency) -> void;
+
+  inline auto pending() const -> bool;
+  inline auto available() const -> uint;
+  inline auto read() -> T;
+  inline auto read(T* samples, uint length) -> uint;  //returns samples read
+  inline auto write(T sample) -> bool;  //false if the queue is full
+  inline auto write(const T* samples, uint length) -> uint;
+
+  inline auto serialize(serializer&) -> bool;  //false if the saved queue is another size
+
+private:
+  inline auto room() const -> uint;
+
+  double _inputFrequency;
+  double _outputFrequency;
+
+  double _ratio;
+  double _fraction;
+  T _history[4];
+  queue<T> _samples;
+};
+
+template<typename T> auto Hermite<T>::reset(double inputFrequency, double outputFrequency, uint queueSize) -> void {
+  _inputFrequency = inputFrequency;
+  _outputFrequency = outputFrequency ? outputFrequency : _inputFrequency;
+
+  _ratio = _inputFrequency / _outputFrequency;
+  _fraction = 0.0;
+  for(auto& sample : _history) sample = 0;
+  _samples.resize(max(queueSize ? queueSize : (uint)(_outputFrequency * 0.02), room() + 1));  //default to 20ms max queue size
+}
+
+template<typename T> auto Hermite<T>::setInputFrequency(double inputFrequency) -> void {
+  _inputFrequency = inputFrequency;
+  _ratio = _inputFrequency / _outputFrequency;
+  if(_samples.size() <= room()) _samples.resize(room() + 1);  //only a tiny queue can be outgrown
+}
+
+template<typename T> auto Hermite<T>::pending() const -> bool {
+  return _samples.pending();
+}
+
+template<typename T> auto Hermite<T>::available() const -> uint {
+  return _samples.count();
+}
+
+template<typename T> auto Hermite<T>::read() -> T {
+  return _samples.read();
+}
+
+template<typename T> auto Hermite<T>::read(T* samples, uint length) -> uint {
+  return _samples.read(samples, length);
+}
+
+template<typename T> auto Hermite<T>::write(T sample) -> bool {
+  return write(&sample, 1);
+}
+
+template<typename T> auto Hermite<T>::write(const T* samples, uint length) -> uint {
+  double mu = _fraction;
+  T s0 = _history[0];
+  T s1 = _history[1];
+  T s2 = _history[2];
+  T s3 = _history[3];
+
+  const uint room = this->room();
+  uint n = 0;
+  for(; n < length && _samples.free() >= room; ++n) {
+    s0 = s1;
+    s1 = s2;
+    s2 = s3;
+    s3 = samples[n];
+
+    //tangents at s1 and s2, as in Interpolation::Hermite
+    T m0 = (s2 - s0) / 2;
+    T m1 = (s3 - s1) / 2;
+
+    while(mu <= 1.0) {
+      T x = mu;
+      T x2 = x * x;
+      T x3 = x2 * x;
+      T a0 = 2 * x3 - 3 * x2 + 1;
+      T a1 = x3 - 2 * x2 + x;
+      T a2 = x3 - x2;
+      T a3 = -2 * x3 + 3 * x2;
+      _samples.write(a0 * s1 + a1 * m0 + a2 * m1 + a3 * s2);
+      mu += _ratio;
+    }
+
+    mu -= 1.0;
+  }
+
+  _fraction = mu;
+  _history[0] = s0;
+  _history[1] = s1;
+  _history[2] = s2;
+  _history[3] = s3;
+  return n;
+}
+
+//the most outputs one input can produce, with a margin for rounding
+template<typename T> auto Hermite<T>::room() const -> uint {
+  return (uint)(1.0 / _ratio) + 2;
+}
+
+template<typename T> auto Hermite<T>::serialize(serializer& s) -> bool {
+  if(!_samples.serialize(s)) return false;
+  s.floatingpoint(_inputFrequency);
+  s.floatingpoint(_outputFrequency);
+  s.floatingpoint(_ratio);
+  s.floatingpoint(_fraction);
+  s.array(_history);
+  return true;
+}
+
+}}}
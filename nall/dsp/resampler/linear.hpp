@@ -0,0 +1,128 @@
+#pragma once
+
+//linear interpolating resampler
+//T is the sample type; write() and read() take single samples or blocks
+
+#include <nall/queue.hpp>
+#include <nall/serializer.hpp>
+
+namespace nall { namespace DSP { namespace Resampler {
+
+template<typename T = double>
+struct Linear {
+  inline auto inputFrequency() const -> double { return _inputFrequency; }
+  inline auto outputFrequency() const -> double { return _outputFrequency; }
+
+  //the queue holds queueSize output samples, 20ms by default, and never less
+  //than one input can produce. A block write stops at the first input whose
+  //output the queue could not hold; it returns how many inputs it took.
+  inline auto reset(double inputFrequency, double outputFrequency = 0, uint queueSize = 0) -> void;
+  inline auto setInputFrequency(double inputFrequency) -> void;
+
+  inline auto pending() const -> bool;
+  inline auto available() const -> uint;
+  inline auto read() -> T;
+  inline auto read(T* samples, uint length) -> uint;  //returns samples read
+  inline auto write(T sample) -> bool;  //false if the queue is full
+  inline auto write(const T* samples, uint length) -> uint;
+
+  inline auto serialize(serializer&) -> bool;  //false if the saved queue is another size
+
+  //lanes form: resamples one input frame of lanes channels kept side by side.
+  //s0 and s1 hold the previous and the current frame, and next() returns
+  //where each output frame goes. Returns the phase for the following input.
+  template<typename Next> static inline auto interpolate(const T* s0, const T* s1, uint lanes, double mu, double ratio, const Next& next) -> double;
+
+private:
+  inline auto room() const -> uint;
+
+  double _inputFrequency;
+  double _outputFrequency;
+
+  double _ratio;
+  double _fraction;
+  T _history[2];
+  queue<T> _samples;
+};
+
+template<typename T> auto Linear<T>::reset(double inputFrequency, double outputFrequency, uint queueSize) -> void {
+  _inputFrequency = inputFrequency;
+  _outputFrequency = outputFrequency ? outputFrequency : _inputFrequency;
+
+  _ratio = _inputFrequency / _outputFrequency;
+  _fraction = 0.0;
+  for(auto& sample : _history) sample = 0;
+  _samples.resize(max(queueSize ? queueSize : (uint)(_outputFrequency * 0.02), room() + 1));  //default to 20ms max queue size
+}
+
+template<typename T> auto Linear<T>::setInputFrequency(double inputFrequency) -> void {
+  _inputFrequency = inputFrequency;
+  _ratio = _inputFrequency / _outputFrequency;
+  if(_samples.size() <= room()) _samples.resize(room() + 1);  //only a tiny queue can be outgrown
+}
+
+template<typename T> auto Linear<T>::pending() const -> bool {
+  return _samples.pending();
+}
+
+template<typename T> auto Linear<T>::available() const -> uint {
+  return _samples.count();
+}
+
+template<typename T> auto Linear<T>::read() -> T {
+  return _samples.read();
+}
+
+template<typename T> auto Linear<T>::read(T* samples, uint length) -> uint {
+  return _samples.read(samples, length);
+}
+
+template<typename T> auto Linear<T>::write(T sample) -> bool {
+  return write(&sample, 1);
+}
+
+template<typename T> auto Linear<T>::write(const T* samples, uint length) -> uint {
+  double mu = _fraction;
+  T s0 = _history[0];
+  T s1 = _history[1];
+
+  const uint room = this->room();
+  uint n = 0;
+  for(; n < length && _samples.free() >= room; ++n) {
+    s0 = s1;
+    s1 = samples[n];
+    mu = interpolate(&s0, &s1, 1, mu, _ratio, [&]() -> T* { return &_samples.next(); });
+  }
+
+  _fraction = mu;
+  _history[0] = s0;
+  _history[1] = s1;
+  return n;
+}
+
+template<typename T> template<typename Next> auto Linear<T>::interpolate(const T* s0, const T* s1, uint lanes, double mu, double ratio, const Next& next) -> double {
+  while(mu <= 1.0) {
+    T x = mu;
+    T* output = next();
+    for(uint lane : range(lanes)) output[lane] = s0[lane] * (1 - x) + s1[lane] * x;
+    mu += ratio;
+  }
+  return mu - 1.0;
+}
+
+//the most outputs one input can produce, with a margin for rounding
+template<typename T> auto Linear<T>::room() const -> uint {
+  return (uint)(1.0 / _ratio) + 2;
+}
+
+template<typename T> auto Linear<T>::serialize(serializer& s) -> bool {
+  if(!_samples.serialize(s)) return false;
+  s.floatingpoint(_inputFrequency);
+  s.floatingpoint(_outputFrequency);
+  s.floatingpoint(_ratio);
+  s.floatingpoint(_fraction);
+  s.array(_history);
+  return true;
+}
+
+}}}
@@ -0,0 +1,172 @@
+#pragma once
+
+//windowed sinc resampler
+//T is the sample type; write() and read() take single samples or blocks
+//Width is the number of taps on each side of the output position. The
+//kernel is a Blackman windowed sinc with its cutoff at 0.95 of the lower
+//Nyquist frequency, stored as a bank of Phases + 1 normalized rows that
+//the output interpolates between.
+
+#include <nall/queue.hpp>
+#include <nall/serializer.hpp>
+#include <nall/vector.hpp>
+
+namespace nall { namespace DSP { namespace Resampler {
+
+template<typename T = double, uint Width = 16>
+struct Sinc {
+  static const uint Phases = 256;
+  static constexpr double Cutoff = 0.95;
+
+  inline auto inputFrequency() const -> double { return _inputFrequency; }
+  inline auto outputFrequency() const -> double { return _outputFrequency; }
+
+  //the queue holds queueSize output samples, 20ms by default, and never less
+  //than one input can produce. A block write stops at the first input whose
+  //output the queue could not hold; it returns how many inputs it took.
+  inline auto reset(double inputFrequency, double outputFrequency = 0, uint queueSize = 0) -> void;
+  inline auto setInputFrequency(double inputFrequency) -> void;  //rebuilds the bank
+
+  inline auto pending() const -> bool;
+  inline auto available() const -> uint;
+  inline auto read() -> T;
+  inline auto read(T* samples, uint length) -> uint;  //returns samples read
+  inline auto write(T sample) -> bool;  //false if the queue is full
+  inline auto write(const T* samples, uint length) -> uint;
+
+  inline auto serialize(serializer&) -> bool;  //false if the saved queue is another size
+
+private:
+  inline auto room() const -> uint;
+
+  inline auto build() -> void;
+
+  double _inputFrequency;
+  double _outputFrequency;
+
+  double _ratio;
+  double _fraction;
+  //the last Width * 2 inputs, stored twice so a window never wraps
+  T _history[Width * 4];
+  uint _offset;
+  vector<T> _bank;
+  queue<T> _samples;
+};
+
+template<typename T, uint Width> auto Sinc<T, Width>::reset(double inputFrequency, double outputFrequency, uint queueSize) -> void {
+  _inputFrequency = inputFrequency;
+  _outputFrequency = outputFrequency ? outputFrequency : _inputFrequency;
+
+  _ratio = _inputFrequency / _outputFrequency;
+  _fraction = 0.0;
+  for(auto& sample : _history) sample = 0;
+  _offset = 0;
+  build();
+  _samples.resize(max(queueSize ? queueSize : (uint)(_outputFrequency * 0.02), room() + 1));  //default to 20ms max queue size
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::setInputFrequency(double inputFrequency) -> void {
+  _inputFrequency = inputFrequency;
+  _ratio = _inputFrequency / _outputFrequency;
+  if(_samples.size() <= room()) _samples.resize(room() + 1);  //only a tiny queue can be outgrown
+  build();
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::pending() const -> bool {
+  return _samples.pending();
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::available() const -> uint {
+  return _samples.count();
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::read() -> T {
+  return _samples.read();
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::read(T* samples, uint length) -> uint {
+  return _samples.read(samples, length);
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::write(T sample) -> bool {
+  return write(&sample, 1);
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::write(const T* samples, uint length) -> uint {
+  double mu = _fraction;
+  uint offset = _offset;
+  const T* bank = _bank.data();
+
+  const uint room = this->room();
+  uint n = 0;
+  for(; n < length && _samples.free() >= room; ++n) {
+    _history[offset] = _history[offset + Width * 2] = samples[n];
+    if(++offset >= Width * 2) offset = 0;
+    const T* window = _history + offset;
+
+    //the output lies between window[Width - 1] and window[Width]
+    while(mu <= 1.0) {
+      double position = mu * Phases;
+      uint phase = min((uint)position, Phases - 1);
+      T x = position - phase;
+      const T* kernel0 = bank + phase * Width * 2;
+      const T* kernel1 = kernel0 + Width * 2;
+      T sum0 = 0, sum1 = 0;
+      for(uint tap : range(Width * 2)) {
+        sum0 += kernel0[tap] * window[tap];
+        sum1 += kernel1[tap] * window[tap];
+      }
+      _samples.write(sum0 + (sum1 - sum0) * x);
+      mu += _ratio;
+    }
+
+    mu -= 1.0;
+  }
+
+  _fraction = mu;
+  _offset = offset;
+  return n;
+}
+
+//the most outputs one input can produce, with a margin for rounding
+template<typename T, uint Width> auto Sinc<T, Width>::room() const -> uint {
+  return (uint)(1.0 / _ratio) + 2;
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::build() -> void {
+  double cutoff = Cutoff * min(1.0, 1.0 / _ratio);
+  _bank.resize((Phases + 1) * Width * 2);
+
+  for(uint phase : range(Phases + 1)) {
+    T* kernel = _bank.data() + phase * Width * 2;
+    double mu = (double)phase / Phases;
+    double taps[Width * 2];
+    double sum = 0.0;
+
+    for(uint tap : range(Width * 2)) {
+      double x = (double)tap - (Width - 1) - mu;  //distance from the output position
+      double y = x * cutoff * Math::Pi;
+      double w = x / Width;
+      double value = fabs(y) < 1e-9 ? 1.0 : sin(y) / y;
+      value *= 0.42 + 0.5 * cos(Math::Pi * w) + 0.08 * cos(2.0 * Math::Pi * w);
+      taps[tap] = value;
+      sum += value;
+    }
+
+    for(uint tap : range(Width * 2)) kernel[tap] = taps[tap] / sum;
+  }
+}
+
+template<typename T, uint Width> auto Sinc<T, Width>::serialize(serializer& s) -> bool {
+  if(!_samples.serialize(s)) return false;
+  s.floatingpoint(_inputFrequency);
+  s.floatingpoint(_outputFrequency);
+  s.floatingpoint(_ratio);
+  s.floatingpoint(_fraction);
+  s.array(_history);
+  s.integer(_offset);
+  if(s.mode() == serializer::Load) build();
+  return true;
+}
+
+}}}
@@ -2,6 +2,8 @@
 
 //simple circular ring buffer
 
+#include <nall/serializer.hpp>
+
 namespace nall {
 
 template<typename T>
@@ -35,6 +37,7 @@ struct queue {
     _write = source._write;
     source._data = nullptr;
     source.reset();
+    return *this;
   }
 
   ~queue() {
@@ -76,6 +79,16 @@ struct queue {
     return _read != _write;
   }
 
+  //number of values written but not yet read
+  auto count() const -> uint {
+    return _write >= _read ? _write - _read : _size - _read + _write;
+  }
+
+  //number of values that can be written before unread ones are overwritten
+  auto free() const -> uint {
+    return _size ? _size - 1 - count() : 0;
+  }
+
   auto read() -> T {
     T result = _data[_read];
     if(++_read >= _size) _read = 0;
@@ -91,6 +104,35 @@ struct queue {
     if(++_write >= _size) _write = 0;
   }
 
+  //claims the next slot for the caller to fill in place of write()
+  auto next() -> T& {
+    T& value = _data[_write];
+    if(++_write >= _size) _write = 0;
+    return value;
+  }
+
+  //reads up to length values; returns how many were read
+  auto read(T* values, uint length) -> uint {
+    if(length > count()) length = count();
+    for(auto n : range(length)) {
+      values[n] = _data[_read];
+      if(++_read >= _size) _read = 0;
+    }
+    return length;
+  }
+
+  //the size is saved with the values; loading into a queue of another size
+  //fails before reading them and leaves the queue unchanged
+  auto serialize(serializer& s) -> bool {
+    uint size = _size;
+    s.integer(size);
+    if(size != _size) return false;
+    s.array(_data, _size);
+    s.integer(_read);
+    s.integer(_write);
+    return true;
+  }
+
 private:
   T* _data = nullptr;
   uint _size = 0;
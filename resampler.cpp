@@ -24,45 +24,109 @@
 using namespace nall;
 
 #ifdef __NALL__
+//Frames are interleaved, one sample per channel. All channel state lives in
+//one 64-byte aligned block: the two state words of each filter stage and
+//the resampler history, each a row with the channels side by side, then
+//the output queue of interleaved frames. Every per-frame loop runs across
+//a row, so the channels filter and interpolate in parallel; interpolation
+//is the lanes form of DSP::Resampler::Linear.
 struct Stream {
-  const uint order = 6;  //Nth-order filter (must be an even number)
-  struct Channel {
-    vector<DSP::IIR::Biquad> iir;
-    DSP::Resampler::Linear resampler;
-  };
-  vector<Channel> channels;
+  static const uint order = 6;  //Nth-order filter (must be an even number)
+  static const uint stages = order / 2;
+  DSP::IIR::Biquad<> iir[stages];  //coefficients only; the state is in the block
+  uint channels = 0;
+  uint stride = 0;  //row length: channels rounded up to a cache line
   bool outputstage;
+  double ratio;
+  double fraction;
+  uint queueFrames = 0;
+  uint queueRead = 0;
+  uint queueCount = 0;
+  uint blockSize = 0;  //in doubles
+  void* allocation = nullptr;
+  double* block = nullptr;
+
+  Stream() = default;
+  Stream(const Stream&) = delete;
+  auto operator=(const Stream&) -> Stream& = delete;
+  ~Stream() { memory::free(allocation); }
+
+  inline auto row(uint index) -> double* {
+    return block + index * stride;
+  }
 
-  inline auto pending() const -> bool {
-    return channels && channels[0].resampler.pending();
+  inline auto frame(uint index) -> double* {
+    return row(stages * 2 + 2) + index * channels;
   }
 
-  inline auto read(double * samples) -> uint {
-    for(auto c : range(channels)) {
-      samples[c] = channels[c].resampler.read();
-      if (outputstage)
-        for(auto& iir : channels[c].iir) samples[c] = iir.process(samples[c]);
+  inline auto filter(double* samples) -> void {
+    for(auto stage : range(stages)) {
+      iir[stage].process(samples, row(stage * 2), row(stage * 2 + 1), channels);
     }
-    return channels.size();
   }
 
-  inline auto write(const double * samples) -> void {
-    for(auto c : range(channels)) {
-      double sample = samples[c] + 1e-25;  //constant offset used to suppress denormals
-      if (!outputstage)
-        for(auto& iir : channels[c].iir) sample = iir.process(sample);
-      channels[c].resampler.write(sample);
-    } 
+  inline auto pending() const -> bool {
+    return queueCount;
   }
 
-  auto reset(uint channels_, double inputFrequency, double outputFrequency) -> void {
-    size_t oldsize = channels.size();
+  inline auto available() const -> uint {
+    return queueCount;
+  }
 
-    if (oldsize != channels_) {
-      channels.reset();
-      channels.resize(channels_);
+  inline auto read(double* samples) -> uint {
+    read(samples, 1);
+    return channels;
+  }
+
+  //reads up to count frames; returns how many were read
+  auto read(double* frames, uint count) -> uint {
+    count = min(count, queueCount);
+    for(auto n : range(count)) {
+      double* samples = frames + n * channels;
+      memory::copy(samples, frame(queueRead), channels * sizeof(double));
+      if(outputstage) filter(samples);
+      if(++queueRead >= queueFrames) queueRead = 0;
+    }
+    queueCount -= count;
+    return count;
+  }
+
+  inline auto write(const double* samples) -> void {
+    write(samples, 1);
+  }
+
+  //takes up to count frames, stopping while the queue could not hold the
+  //output of one more; returns how many were taken
+  auto write(const double* frames, uint count) -> uint {
+    const uint room = (uint)(1.0 / ratio) + 2;
+    double* s0 = row(stages * 2);
+    double* s1 = row(stages * 2 + 1);
+    double mu = fraction;
+    uint queueWrite = queueRead + queueCount;
+    if(queueWrite >= queueFrames) queueWrite -= queueFrames;
+
+    uint taken = 0;
+    for(; taken < count && queueFrames - queueCount >= room; ++taken) {
+      const double* samples = frames + taken * channels;
+      for(auto c : range(channels)) {
+        s0[c] = s1[c];
+        s1[c] = samples[c] + 1e-25;  //constant offset used to suppress denormals
+      }
+      if(!outputstage) filter(s1);
+
+      mu = DSP::Resampler::Linear<>::interpolate(s0, s1, channels, mu, ratio, [&]() -> double* {
+        double* out = frame(queueWrite);
+        if(++queueWrite >= queueFrames) queueWrite = 0;
+        ++queueCount;
+        return out;
+      });
     }
 
+    fraction = mu;
+    return taken;
+  }
+
+  auto reset(uint channels_, double inputFrequency, double outputFrequency) -> void {
     double ratio_ = outputFrequency / inputFrequency;
 
     outputstage = (ratio_ >= 1.0);
@@ -75,15 +139,65 @@ struct Stream {
     }
     ratio_ = min(ratio_, 0.45);
 
-    for(auto& channel : channels) {
-      channel.iir.resize(order / 2);
-      for(auto phase : range(order / 2)) {
-        double q = DSP::IIR::Biquad::butterworth(order, phase);
-        channel.iir[phase].reset(DSP::IIR::Biquad::Type::LowPass, ratio_, q);
-      }
+    for(auto phase : range(stages)) {
+      double q = DSP::IIR::Biquad<>::butterworth(order, phase);
+      iir[phase].reset(DSP::IIR::Biquad<>::Type::LowPass, ratio_, q);
+    }
 
-      channel.resampler.reset(inputFrequency, outputFrequency);
+    ratio = inputFrequency / outputFrequency;
+    fraction = 0.0;
+
+    //20ms of output, and at least what one input frame can produce
+    uint frames = max((uint)(outputFrequency * 0.02), (uint)(1.0 / ratio) + 2);
+    uint rowSize = (channels_ + 7) & ~7;
+    uint size = ( stages * 2 + 2 ) * rowSize + frames * channels_;
+
+    if(channels_ != channels || frames != queueFrames) {
+      memory::free(allocation);
+      allocation = memory::allocate(size * sizeof(double) + 63);
+      block = (double*)(((uintptr_t)allocation + 63) & ~(uintptr_t)63);
+      channels = channels_;
+      stride = rowSize;
+      queueFrames = frames;
+      blockSize = size;
     }
+    memory::fill(block, blockSize * sizeof(double));
+    queueRead = 0;
+    queueCount = 0;
+  }
+
+  //snapshot of the filter and resampler state; a stream reset to the same
+  //channel count and frequencies continues from it sample for sample
+  static const uint SerializerSignature = 0x4d525453;  //"STRM"
+  static const uint SerializerVersion = 2;
+
+  auto serialize(serializer& s) -> void {
+    s.integer(outputstage);
+    s.floatingpoint(fraction);
+    s.integer(queueRead);
+    s.integer(queueCount);
+    s.array(block, blockSize);
+  }
+
+  auto serialize() -> serializer {
+    uint signature = SerializerSignature, version = SerializerVersion, count = channels, frames = queueFrames;
+    serializer size;
+    size.integer(signature).integer(version).integer(count).integer(frames);
+    serialize(size);
+
+    serializer s(size.size());
+    s.integer(signature).integer(version).integer(count).integer(frames);
+    serialize(s);
+    return s;
+  }
+
+  auto unserialize(serializer& s) -> bool {
+    uint signature = 0, version = 0, count = 0, frames = 0;
+    s.integer(signature).integer(version).integer(count).integer(frames);
+    if(signature != SerializerSignature || version != SerializerVersion) return false;
+    if(count != channels || frames != queueFrames) return false;
+    serialize(s);
+    return true;
   }
 };
 #endif
@@ -231,7 +345,7 @@ struct Stream {
 
 #include <nall/main.hpp>
 auto nall::main(lstring args) -> void {
-  nall::file rd, wr;
+  nall::file wr;
   double inFreq, outFreq;
   bool bench = false;
 
@@ -250,6 +364,16 @@ auto nall::main(lstring args) -> void {
   else {
     inFreq = real( args[3] );
     outFreq = real( args[4] );
+
+    if (!(inFreq > 0.0 && inFreq <= 384000.0)) {
+      print("Invalid source rate: ", inFreq, "\n\n");
+      return;
+    }
+
+    if (!(outFreq > 0.0 && outFreq <= 384000.0)) {
+      print("Invalid target rate: ", outFreq, "\n\n");
+      return;
+    }
   }
 
 #ifdef __K54__
@@ -309,75 +433,107 @@ auto nall::main(lstring args) -> void {
     }
   }
 
-  if (inFreq <= 0.0 || inFreq > 384000.0) {
-    print("Invalid source rate: ", inFreq, "\n\n");
+  monkee_limiter::limiter lim;
+
+  // Both files are mapped, so samples are read from and written to the page
+  // cache directly. The input length comes from the file size; the output is
+  // sized for the worst case up front and trimmed to what was produced.
+  // An empty file cannot be mapped, so it is the one input allowed to go
+  // unmapped; it resamples to an empty output.
+  filemap rd;
+  bool empty = file::exists(args[1]) && file::size(args[1]) == 0;
+  if (!empty && !rd.open(args[1], filemap::mode::read)) {
+    print("Unable to open input: ", args[1], "\n\n");
+    return;
+  }
+
+  const float * in = (const float *) rd.data();
+  size_t in_count = rd.size() / sizeof(float);
+  size_t out_cap = (size_t) ceil(in_count * outFreq / inFreq) + 4096;
+
+  if (!wr.open(args[2], file::mode::write) || !wr.truncate(out_cap * sizeof(float))) {
+    print("Unable to create output: ", args[2], "\n\n");
     return;
   }
+  wr.close();
 
-  if (outFreq <= 0.0 || outFreq > 384000.0) {
-    print("Invalid target rate: ", outFreq, "\n\n");
+  filemap wm(args[2], filemap::mode::writeread);
+  if (!wm.open()) {
+    print("Unable to create output: ", args[2], "\n\n");
     return;
   }
 
-  monkee_limiter::limiter lim;
+  float * out = (float *) wm.data();
+  size_t out_made = 0;
 
-  rd.open( args[1], file::mode::read );
-  wr.open( args[2], file::mode::write );
+  if (in_count) {
+#ifdef __K54__
+    enum { block_size = 4096 };
+    size_t in_pos = 0;
 
-  uint32 sample32 = rd.readl(4);
-  float sample;
+    while (in_pos < in_count && out_made < out_cap) {
+      size_t in_used, block_made;
+      size_t block_cap = min((size_t) block_size, out_cap - out_made);
+      float * block = out + out_made;
 
-  while (sample32 != 0xFFFFFFFF) {
-    *(uint32 *)(&sample) = sample32;
-    double sampled = sample;
-#ifdef __K54__
-    resampler_write_sample_float(resampler, sampled);
-    while (resampler_get_sample_count(resampler)) {
-      sampled = resampler_get_sample_float(resampler);
-      resampler_remove_sample(resampler, 0);
-      sample = sampled;
-      sample = lim.process_sample(sample) * 0.999;
-      uint32 sampleout32;
-      *(float *)(&sampleout32) = sample;
-      wr.writel(sampleout32, 4);
+      resampler_process_float(resampler, in + in_pos, in_count - in_pos, &in_used, block, block_cap, &block_made);
+      if (!in_used && !block_made)
+        break;
+
+      lim.process_block(block, block, block_made);
+      for (size_t i = 0; i < block_made; ++i)
+        block[i] = block[i] * 0.999;
+
+      in_pos += in_used;
+      out_made += block_made;
     }
 #elif defined(__NALL__)
-    dsp.write(&sampled);
-    while (dsp.pending()) {
-      dsp.read(&sampled);
-      sample = sampled;
-      sample = lim.process_sample(sample) * 0.999;
-      uint32 sampleout32;
-      *(float *)(&sampleout32) = sample;
-      wr.writel(sampleout32, 4);
+    enum { block_size = 1024 };
+    double block[block_size];
+    size_t in_pos = 0;
+
+    while (in_pos < in_count) {
+      uint block_len = min((size_t) block_size, in_count - in_pos);
+      uint made;
+
+      for (uint i = 0; i < block_len; ++i)
+        block[i] = in[in_pos + i];
+      in_pos += dsp.write(block, block_len);
+
+      while ((made = dsp.read(block, block_size))) {
+        float * limited = out + out_made;
+        made = min((size_t) made, out_cap - out_made);
+        for (uint i = 0; i < made; ++i)
+          limited[i] = block[i];
+        lim.process_block(limited, limited, made);
+        for (uint i = 0; i < made; ++i)
+          limited[i] = limited[i] * 0.999;
+        out_made += made;
+      }
     }
 #elif defined(__SOX__)
-    dsp.write(&sampled);
-    while (dsp.pending()) {
-      dsp.read(&sampled);
-      sample = sampled;
-      sample = lim.process_sample(sample) * 0.999;
-      uint32 sampleout32;
-      *(float *)(&sampleout32) = sample;
-      wr.writel(sampleout32, 4);
-    }
-#endif
-    sample32 = rd.readl(4);
-#ifdef __SOX__
-    if (sample32 == 0xFFFFFFFF) {
-      dsp.flush();
+    for (size_t i = 0; i < in_count; ++i) {
+      double sampled = in[i];
+      dsp.write(&sampled);
+      if (i + 1 == in_count)
+        dsp.flush();
       while (dsp.pending()) {
         dsp.read(&sampled);
-        sample = sampled;
-        sample = lim.process_sample(sample) * 0.999;
-        uint32 sampleout32;
-        *(float *)(&sampleout32) = sample;
-        wr.writel(sampleout32, 4);
+        if (out_made < out_cap)
+          out[out_made++] = lim.process_sample(sampled) * 0.999;
       }
     }
 #endif
   }
 
+  wm.close();
+  rd.close();
+
+  if (wr.open(args[2], file::mode::readwrite)) {
+    wr.truncate(out_made * sizeof(float));
+    wr.close();
+  }
+
 #ifdef __K54__
   resampler_delete(resampler);
 #endif
@@ -0,0 +1,94 @@
+//the block, lanes and cascade forms of nall::DSP::IIR::Biquad must match
+//per-sample process() bit for bit, in double and in float
+
+#include <nall/nall.hpp>
+#include <nall/dsp/iir/biquad.hpp>
+
+using namespace nall;
+
+enum : uint { samples = 2048, lanes = 5, filters = 4 };
+
+static uint failures = 0;
+
+template<typename T>
+auto compare(const char* name, uint type, const char* form, const T* output, const T* expected, uint length) -> void {
+  if(memory::compare(output, expected, length * sizeof(T))) {
+    print(name, " type ", type, " ", form, ": differs from per-sample process\n");
+    failures++;
+  }
+}
+
+template<typename T>
+auto check(const char* name, typename DSP::IIR::Biquad<T>::Type type, double gain) -> void {
+  using Biquad = DSP::IIR::Biquad<T>;
+  static T input[samples], expected[samples], output[samples];
+  for(uint n : range(samples)) input[n] = sin(n * 0.01) + 0.25 * sin(n * 0.37) + (n == 700 ? 0.8 : 0.0);
+
+  Biquad reference, filter;
+  reference.reset(type, 0.1, 0.707, gain);
+  filter.reset(type, 0.1, 0.707, gain);
+  for(uint n : range(samples)) expected[n] = reference.process(input[n]);
+
+  //uneven blocks, so the state carries across calls
+  for(uint offset = 0, length = 1; offset < samples; offset += length, length = length * 3 + 1) {
+    filter.process(input + offset, output + offset, min(length, samples - offset));
+  }
+  compare(name, (uint)type, "block", output, expected, samples);
+
+  filter.reset(type, 0.1, 0.707, gain);
+  memory::copy(output, input, sizeof(input));
+  filter.process(output, output, samples);
+  compare(name, (uint)type, "in place", output, expected, samples);
+
+  //each lane runs the input scaled differently through the shared coefficients
+  static T frames[samples][lanes], expectedFrames[samples][lanes];
+  for(uint lane : range(lanes)) {
+    reference.reset(type, 0.1, 0.707, gain);
+    for(uint n : range(samples)) {
+      frames[n][lane] = input[n] * T(lane + 1) / T(lanes);
+      expectedFrames[n][lane] = reference.process(frames[n][lane]);
+    }
+  }
+  T z1[lanes] = {}, z2[lanes] = {};
+  for(uint n : range(samples)) filter.process(frames[n], z1, z2, lanes);
+  compare(name, (uint)type, "lanes", &frames[0][0], &expectedFrames[0][0], samples * lanes);
+
+  //butterworth stages in series, each fed the previous one's output
+  Biquad chain[filters], stages[filters];
+  for(uint phase : range(filters)) {
+    double q = Biquad::butterworth(filters * 2, phase);
+    chain[phase].reset(type, 0.1, q, gain);
+    stages[phase].reset(type, 0.1, q, gain);
+  }
+  for(uint n : range(samples)) {
+    T sample = input[n];
+    for(uint phase : range(filters)) sample = chain[phase].process(sample);
+    expected[n] = sample;
+  }
+  Biquad::cascade(stages, filters, input, output, samples / 2);
+  Biquad::cascade(stages, filters, input + samples / 2, output + samples / 2, samples / 2);
+  compare(name, (uint)type, "cascade", output, expected, samples);
+
+  Biquad::cascade(stages, 0, input, output, samples);
+  compare(name, (uint)type, "empty cascade", output, input, samples);
+}
+
+template<typename T>
+auto checkAll(const char* name) -> void {
+  using Type = typename DSP::IIR::Biquad<T>::Type;
+  check<T>(name, Type::LowPass, 0.0);
+  check<T>(name, Type::HighPass, 0.0);
+  check<T>(name, Type::BandPass, 0.0);
+  check<T>(name, Type::Notch, 0.0);
+  check<T>(name, Type::Peak, 6.0);
+  check<T>(name, Type::LowShelf, -6.0);
+  check<T>(name, Type::HighShelf, 6.0);
+}
+
+#include <nall/main.hpp>
+auto nall::main(lstring) -> void {
+  checkAll<double>("Biquad<double>");
+  checkAll<float>("Biquad<float>");
+  print(failures ? "FAILED\n" : "passed\n");
+  if(failures) exit(EXIT_FAILURE);
+}
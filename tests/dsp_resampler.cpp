@@ -0,0 +1,110 @@
+//block writes to the nall::DSP::Resampler family must match per-sample
+//writes even when one block produces more than the output queue holds, and
+//a saved state must restore only into a resampler with the same queue size
+
+#include <nall/nall.hpp>
+#include <nall/dsp/resampler/linear.hpp>
+#include <nall/dsp/resampler/cubic.hpp>
+#include <nall/dsp/resampler/hermite.hpp>
+#include <nall/dsp/resampler/sinc.hpp>
+
+using namespace nall;
+
+enum : uint { inputs = 4096, capacity = inputs * 8 };
+
+static uint failures = 0;
+
+template<typename Resampler>
+auto check(const char* name, double inputFrequency, double outputFrequency) -> void {
+  using T = decltype(declval<Resampler&>().read());
+  static T input[inputs], expected[capacity], output[capacity];
+  for(uint n : range(inputs)) input[n] = sin(n * 0.01) + 0.25 * sin(n * 0.37);
+
+  Resampler reference;
+  reference.reset(inputFrequency, outputFrequency);
+  uint expectedCount = 0;
+  for(uint n : range(inputs)) {
+    reference.write(input[n]);
+    while(reference.pending()) expected[expectedCount++] = reference.read();
+  }
+
+  Resampler resampler;
+  resampler.reset(inputFrequency, outputFrequency);
+  uint taken = resampler.write(input, inputs);
+  bool stopped = taken < inputs && resampler.available() > 0;
+  uint outputCount = resampler.read(output, capacity);
+  while(taken < inputs) {
+    taken += resampler.write(input + taken, inputs - taken);
+    outputCount += resampler.read(output + outputCount, capacity - outputCount);
+  }
+
+  bool matched = stopped && outputCount == expectedCount;
+  for(uint n : range(min(outputCount, expectedCount))) {
+    if(memory::compare(&output[n], &expected[n], sizeof(T))) matched = false;
+  }
+  if(!matched) {
+    print(name, " ", (uint)inputFrequency, " -> ", (uint)outputFrequency, ": ",
+      outputCount, " of ", expectedCount, " samples", stopped ? "" : ", write did not stop at a full queue", "\n");
+    failures++;
+  }
+}
+
+template<typename Resampler>
+auto checkSerialize(const char* name) -> void {
+  using T = decltype(declval<Resampler&>().read());
+  T input[256], expected[1024], output[1024];
+  for(uint n : range(256)) input[n] = sin(n * 0.05);
+
+  Resampler resampler;
+  resampler.reset(44100, 48000);
+  resampler.write(input, 256);
+  resampler.read(expected, 100);
+
+  serializer size;
+  resampler.serialize(size);
+  serializer save(size.size());
+  resampler.serialize(save);
+
+  Resampler restored;
+  restored.reset(44100, 48000);
+  serializer load(save.data(), save.size());
+  bool loaded = restored.serialize(load);
+
+  Resampler other;
+  other.reset(44100, 48000, 500);
+  serializer mismatch(save.data(), save.size());
+  bool rejected = !other.serialize(mismatch);
+
+  bool matched = loaded;
+  if(loaded) {
+    resampler.write(input, 256);
+    restored.write(input, 256);
+    uint expectedCount = resampler.read(expected, 1024);
+    uint outputCount = restored.read(output, 1024);
+    matched = outputCount == expectedCount && !memory::compare(output, expected, outputCount * sizeof(T));
+  }
+  if(!matched || !rejected) {
+    print(name, " serialize: ", matched ? "" : "restored state differs", matched || rejected ? "" : ", ",
+      rejected ? "" : "loaded into another queue size", "\n");
+    failures++;
+  }
+}
+
+template<typename Resampler>
+auto checkAll(const char* name) -> void {
+  check<Resampler>(name, 44100, 48000);
+  check<Resampler>(name, 48000, 44100);
+  check<Resampler>(name, 22050, 96000);
+  checkSerialize<Resampler>(name);
+}
+
+#include <nall/main.hpp>
+auto nall::main(lstring) -> void {
+  checkAll<DSP::Resampler::Linear<>>("Linear");
+  checkAll<DSP::Resampler::Cubic<>>("Cubic");
+  checkAll<DSP::Resampler::Hermite<>>("Hermite");
+  checkAll<DSP::Resampler::Sinc<>>("Sinc");
+  checkAll<DSP::Resampler::Linear<float>>("Linear<float>");
+  print(failures ? "FAILED\n" : "passed\n");
+  if(failures) exit(EXIT_FAILURE);
+}
@@ -0,0 +1,212 @@
+// The block interfaces of the k54 resampler must produce exactly what the
+// per-sample ones do: resampler_process_float() and resampler_read_float()
+// against the write_sample_float / get_sample_float loop, and the s16, s24
+// and s32 block writers against resampler_write_sample(_fixed).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../k54/resampler.h"
+
+enum { INPUTS = 12000, CAPACITY = INPUTS * 3 };
+
+static float input[INPUTS], expected[CAPACITY], output[CAPACITY];
+static short input_s16[INPUTS];
+static unsigned char input_s24[INPUTS * 3];
+static int input_s32[INPUTS], input_bits[INPUTS];
+static int failures = 0;
+
+static const double factors[] = { 44100.0 / 48000.0, 48000.0 / 44100.0, 0.5, 1.0, 3.0, 70.0 };
+
+static unsigned int seed;
+
+static int next_random(void)
+{
+    seed = seed * 1103515245u + 12345u;
+    return (int)( seed >> 1 );
+}
+
+static void * create(int quality, double factor, size_t buffer_frames)
+{
+    void * r = resampler_create_ex( buffer_frames );
+    resampler_set_quality( r, quality );
+    resampler_set_rate( r, factor );
+    return r;
+}
+
+static void compare(const char * what, int quality, double factor, int count, int expected_count)
+{
+    if ( count != expected_count || memcmp( output, expected, count * sizeof(float) ) )
+    {
+        printf( "%s, quality %d, factor %g: %d of %d samples or contents differ\n", what, quality, factor, count, expected_count );
+        failures++;
+    }
+}
+
+// the per-sample reference: fill until the ring is full, then drain it
+static int reference(int quality, double factor)
+{
+    void * r = create( quality, factor, 0 );
+    int in = 0, out = 0;
+    for (;;)
+    {
+        int drained = 0;
+        while ( in < INPUTS && resampler_get_free_count( r ) > 0 )
+            resampler_write_sample_float( r, input[in++] );
+        while ( out < CAPACITY && resampler_get_sample_count( r ) > 0 )
+        {
+            expected[out++] = resampler_get_sample_float( r );
+            resampler_remove_sample( r, 1 );
+            drained = 1;
+        }
+        if ( in == INPUTS && !drained ) break;
+    }
+    resampler_delete( r );
+    return out;
+}
+
+static void check_process(int quality, double factor, int count, int chunk)
+{
+    void * r = create( quality, factor, chunk > 512 ? 4096 : 0 );
+    size_t in = 0, out = 0;
+    char what[32];
+    for (;;)
+    {
+        size_t in_used, out_made;
+        size_t in_count = INPUTS - in < (size_t)chunk ? INPUTS - in : (size_t)chunk;
+        size_t out_cap = CAPACITY - out < (size_t)chunk ? CAPACITY - out : (size_t)chunk;
+        resampler_process_float( r, input + in, in_count, &in_used, output + out, out_cap, &out_made );
+        in += in_used;
+        out += out_made;
+        if ( !in_used && !out_made ) break;
+    }
+    resampler_delete( r );
+    sprintf( what, "process_float, chunk %d", chunk );
+    compare( what, quality, factor, (int)out, count );
+}
+
+static void check_read(int quality, double factor, int count)
+{
+    void * r = create( quality, factor, 0 );
+    int in = 0, out = 0;
+    seed = 5;
+    for (;;)
+    {
+        int want = 1 + next_random() % 37, got;
+        while ( in < INPUTS && resampler_get_free_count( r ) > 0 )
+            resampler_write_sample_float( r, input[in++] );
+        if ( want > CAPACITY - out ) want = CAPACITY - out;
+        got = resampler_read_float( r, output + out, want );
+        out += got;
+        if ( in == INPUTS && !got ) break;
+    }
+    resampler_delete( r );
+    compare( "read_float", quality, factor, out, count );
+}
+
+// format 16, 24 or 32; depth only applies to 32
+static int run_integer(int quality, double factor, int format, int depth, int block, float * out_)
+{
+    void * r = create( quality, factor, 1000 );
+    int in = 0, out = 0, got;
+    seed = 9;
+    while ( in < INPUTS )
+    {
+        if ( block )
+        {
+            int count = next_random() % 700;
+            if ( count > INPUTS - in ) count = INPUTS - in;
+            if ( format == 16 )
+                in += resampler_write_block_s16( r, input_s16 + in, count );
+            else if ( format == 24 )
+                in += resampler_write_block_s24( r, input_s24 + in * 3, count );
+            else
+                in += resampler_write_block_s32( r, input_s32 + in, count, (unsigned char)depth );
+        }
+        else
+        {
+            while ( in < INPUTS && resampler_get_free_count( r ) > 0 )
+            {
+                if ( format == 16 )
+                    resampler_write_sample( r, input_s16[in] );
+                else if ( format == 24 )
+                {
+                    const unsigned char * p = input_s24 + in * 3;
+                    resampler_write_sample_fixed( r, (int)( (unsigned)p[0] << 8 | (unsigned)p[1] << 16 | (unsigned)p[2] << 24 ) >> 8, 24 );
+                }
+                else
+                    resampler_write_sample_fixed( r, input_s32[in], (unsigned char)depth );
+                ++in;
+            }
+        }
+        while ( ( got = resampler_read_float( r, out_ + out, CAPACITY - out < 512 ? CAPACITY - out : 512 ) ) > 0 )
+            out += got;
+    }
+    resampler_delete( r );
+    return out;
+}
+
+static void check_integer(int quality, double factor, int format, int depth)
+{
+    int i, count, block_count;
+    char what[32];
+    // s32 samples span the given depth, with the top value in range
+    for (i = 0; format == 32 && i < INPUTS; ++i)
+        input_s32[i] = depth == 32 ? input_bits[i] : input_bits[i] >> ( 32 - depth );
+    count = run_integer( quality, factor, format, depth, 0, expected );
+    block_count = run_integer( quality, factor, format, depth, 1, output );
+    sprintf( what, "write_block_s%d, depth %d", format, depth );
+    compare( what, quality, factor, block_count, count );
+}
+
+static void fill_input(void)
+{
+    int i;
+    seed = 1;
+    for (i = 0; i < INPUTS; ++i)
+    {
+        int v = next_random();
+        input[i] = 0.5f * sinf( i * 0.05f ) + ( ( next_random() % 2000 ) - 1000 ) / 4000.0f;
+        // full scale and zero samples in every format
+        if ( i % 97 == 0 ) v = 0;
+        if ( i % 89 == 0 ) v = 0x7fffffff;
+        input_s16[i] = (short)( ( v - 0x40000000 ) >> 15 );
+        input_bits[i] = (int)( (unsigned)v * 2u ) ^ ( next_random() & 1 );
+        v = ( v >> 7 ) - ( 1 << 23 );
+        input_s24[i * 3] = (unsigned char)v;
+        input_s24[i * 3 + 1] = (unsigned char)( v >> 8 );
+        input_s24[i * 3 + 2] = (unsigned char)( v >> 16 );
+    }
+}
+
+int main(void)
+{
+    int quality, f;
+
+    resampler_init();
+    fill_input();
+
+    for (quality = RESAMPLER_QUALITY_MIN; quality <= RESAMPLER_QUALITY_MAX; ++quality)
+    {
+        for (f = 0; f < (int)( sizeof(factors) / sizeof(factors[0]) ); ++f)
+        {
+            int count = reference( quality, factors[f] );
+            check_process( quality, factors[f], count, 7 );
+            check_process( quality, factors[f], count, 64 );
+            check_process( quality, factors[f], count, 1000 );
+            check_read( quality, factors[f], count );
+        }
+        check_integer( quality, 1.0884, 16, 0 );
+        check_integer( quality, 1.0884, 24, 0 );
+        check_integer( quality, 1.0884, 32, 32 );
+        check_integer( quality, 1.0884, 32, 20 );
+        check_integer( quality, 7.0, 16, 0 );
+        check_integer( quality, 7.0, 24, 0 );
+        check_integer( quality, 7.0, 32, 24 );
+    }
+
+    printf( failures ? "FAILED\n" : "passed\n" );
+    return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,172 @@
+// The multichannel k54 resampler must resample each channel like a mono
+// instance would. It sums its kernels in another order, so samples agree
+// to rounding rather than bit for bit; the planar form must match the
+// interleaved one exactly. BLEP has no multichannel engine and must be
+// refused.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../k54/resampler.h"
+
+enum { FRAMES = 6000, CAPACITY = FRAMES * 2, MAX_CHANNELS = 8 };
+
+static const float tolerance = 1e-6f;
+
+static float input[FRAMES * MAX_CHANNELS], output[CAPACITY * MAX_CHANNELS];
+static float planar_input[MAX_CHANNELS][FRAMES], planar_output[MAX_CHANNELS][CAPACITY];
+static float mono_input[FRAMES], mono_output[CAPACITY];
+static int failures = 0;
+
+// factor 0 selects the rational 147 / 160
+static void * create_mc(int channels, int quality, double factor)
+{
+    void * r = resampler_mc_create( channels );
+    resampler_mc_set_quality( r, quality );
+    if ( factor )
+        resampler_mc_set_rate( r, factor );
+    else
+        resampler_mc_set_rate_rational( r, 147, 160 );
+    return r;
+}
+
+static int run_mono(int quality, double factor)
+{
+    void * r = resampler_create();
+    size_t in = 0, out = 0;
+    resampler_set_quality( r, quality );
+    if ( factor )
+        resampler_set_rate( r, factor );
+    else
+        resampler_set_rate_rational( r, 147, 160 );
+    for (;;)
+    {
+        size_t in_used, out_made;
+        resampler_process_float( r, mono_input + in, FRAMES - in, &in_used, mono_output + out, CAPACITY - out, &out_made );
+        in += in_used;
+        out += out_made;
+        if ( !in_used && !out_made ) break;
+    }
+    resampler_delete( r );
+    return (int)out;
+}
+
+// odd chunk sizes on both sides, so calls end mid-kernel
+static int run_interleaved(int channels, int quality, double factor)
+{
+    void * r = create_mc( channels, quality, factor );
+    size_t in = 0, out = 0;
+    for (;;)
+    {
+        size_t in_used, out_made;
+        size_t in_count = FRAMES - in < 777 ? FRAMES - in : 777;
+        size_t out_cap = CAPACITY - out < 501 ? CAPACITY - out : 501;
+        resampler_mc_process_float( r, input + in * channels, in_count, &in_used, output + out * channels, out_cap, &out_made );
+        in += in_used;
+        out += out_made;
+        if ( !in_used && !out_made ) break;
+    }
+    resampler_mc_delete( r );
+    return (int)out;
+}
+
+static int run_planar(int channels, int quality, double factor)
+{
+    void * r = create_mc( channels, quality, factor );
+    size_t in = 0, out = 0;
+    for (;;)
+    {
+        const float * in_ptr[MAX_CHANNELS];
+        float * out_ptr[MAX_CHANNELS];
+        size_t in_used, out_made;
+        size_t in_count = FRAMES - in < 333 ? FRAMES - in : 333;
+        size_t out_cap = CAPACITY - out < 400 ? CAPACITY - out : 400;
+        int c;
+        for (c = 0; c < channels; ++c)
+        {
+            in_ptr[c] = planar_input[c] + in;
+            out_ptr[c] = planar_output[c] + out;
+        }
+        resampler_mc_process_planar_float( r, in_ptr, in_count, &in_used, out_ptr, out_cap, &out_made );
+        in += in_used;
+        out += out_made;
+        if ( !in_used && !out_made ) break;
+    }
+    resampler_mc_delete( r );
+    return (int)out;
+}
+
+static void check(int channels, int quality, double factor)
+{
+    int frames = run_interleaved( channels, quality, factor );
+    int planar_frames = run_planar( channels, quality, factor );
+    int c, i, mono_mismatch = 0, planar_mismatch = planar_frames != frames;
+
+    for (c = 0; c < channels; ++c)
+    {
+        int mono_frames;
+        for (i = 0; i < FRAMES; ++i)
+            mono_input[i] = input[i * channels + c];
+        mono_frames = run_mono( quality, factor );
+        if ( mono_frames != frames )
+            mono_mismatch = 1;
+        for (i = 0; i < frames && i < mono_frames; ++i)
+            if ( fabsf( output[i * channels + c] - mono_output[i] ) > tolerance )
+                mono_mismatch = 1;
+        for (i = 0; i < frames && i < planar_frames; ++i)
+            if ( memcmp( &output[i * channels + c], &planar_output[c][i], sizeof(float) ) )
+                planar_mismatch = 1;
+    }
+
+    if ( mono_mismatch || planar_mismatch )
+    {
+        printf( "%d channels, quality %d, factor %g: %s%s%s\n", channels, quality, factor ? factor : 147.0 / 160.0,
+            mono_mismatch ? "differs from mono" : "", mono_mismatch && planar_mismatch ? ", " : "",
+            planar_mismatch ? "planar differs from interleaved" : "" );
+        failures++;
+    }
+}
+
+static void check_blep(void)
+{
+    void * r = resampler_mc_create( 2 );
+    int before = resampler_mc_set_quality( r, RESAMPLER_QUALITY_CUBIC );
+    int after = resampler_mc_set_quality( r, RESAMPLER_QUALITY_BLEP );
+    if ( before != RESAMPLER_QUALITY_CUBIC || after != RESAMPLER_QUALITY_CUBIC )
+    {
+        printf( "BLEP: set_quality returned %d, expected the previous quality %d\n", after, before );
+        failures++;
+    }
+    resampler_mc_delete( r );
+}
+
+int main(void)
+{
+    static const int channel_counts[] = { 1, 2, 3, 8 };
+    static const int qualities[] = { RESAMPLER_QUALITY_ZOH, RESAMPLER_QUALITY_LINEAR, RESAMPLER_QUALITY_BLAM, RESAMPLER_QUALITY_CUBIC, RESAMPLER_QUALITY_SINC };
+    // mono decimates from a factor of 4, which this engine does not
+    static const double factors[] = { 0.9, 1.0884, 2.5, 0 };
+    int i, c, n, q, f;
+
+    resampler_init();
+    for (i = 0; i < FRAMES; ++i)
+        for (c = 0; c < MAX_CHANNELS; ++c)
+            planar_input[c][i] = 0.5f * sinf( i * 0.01f * ( c + 1 ) ) + 0.2f * sinf( i * ( 0.3f + 0.1f * c ) );
+
+    check_blep();
+    for (n = 0; n < (int)( sizeof(channel_counts) / sizeof(channel_counts[0]) ); ++n)
+    {
+        int channels = channel_counts[n];
+        for (i = 0; i < FRAMES; ++i)
+            for (c = 0; c < channels; ++c)
+                input[i * channels + c] = planar_input[c][i];
+        for (q = 0; q < (int)( sizeof(qualities) / sizeof(qualities[0]) ); ++q)
+            for (f = 0; f < (int)( sizeof(factors) / sizeof(factors[0]) ); ++f)
+                check( channels, qualities[q], factors[f] );
+    }
+
+    printf( failures ? "FAILED\n" : "passed\n" );
+    return failures ? EXIT_FAILURE : 0;
+}
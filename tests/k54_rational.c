@@ -0,0 +1,90 @@
+// An exact rational factor num / den must never drift: fed a signal that
+// repeats every num input samples, the resampler must take exactly num
+// inputs for every den outputs and repeat its output bit for bit every den
+// samples, which no accumulated floating point phase manages for long.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../k54/resampler.h"
+
+enum { PERIODS = 64, WARMUP = 4, MAX_PERIOD = 4096 };
+
+static float period_output[2][MAX_PERIOD];
+static int failures = 0;
+
+static int drain(void * r, float * out, int made)
+{
+    while ( resampler_get_sample_count( r ) > 0 )
+    {
+        if ( made < MAX_PERIOD )
+            out[made] = resampler_get_sample_float( r );
+        resampler_remove_sample( r, 1 );
+        ++made;
+    }
+    return made;
+}
+
+// The input repeats every num * 4 samples, so it also repeats every num
+// samples behind a decimator that halves the rate up to twice.
+static void check(int quality, unsigned int num, unsigned int den)
+{
+    const int in_period = (int)num * 4, out_period = (int)den * 4;
+    void * r = resampler_create();
+    int period, i, drifted = 0, differs = 0;
+
+    resampler_set_quality( r, quality );
+    resampler_set_rate_rational( r, num, den );
+
+    for (period = 0; period < PERIODS; ++period)
+    {
+        float * current = period_output[period & 1];
+        const float * previous = period_output[( period & 1 ) ^ 1];
+        int made = 0;
+        for (i = 0; i < in_period; ++i)
+        {
+            double t = (double)i / in_period;
+            if ( !resampler_get_free_count( r ) )
+                made = drain( r, current, made );
+            resampler_write_sample_float( r, (float)( 0.5 * sin( 2 * M_PI * t ) + 0.25 * sin( 2 * M_PI * 7 * t ) ) );
+        }
+        made = drain( r, current, made );
+        if ( period < WARMUP )
+            continue;
+        if ( made != out_period )
+            drifted = 1;
+        // BLEP integrates its steps into a running sum, which never repeats
+        // exactly, so only its sample count is checked
+        else if ( quality != RESAMPLER_QUALITY_BLEP && period > WARMUP && memcmp( current, previous, out_period * sizeof(float) ) )
+            differs = 1;
+    }
+    resampler_delete( r );
+
+    if ( drifted || differs )
+    {
+        printf( "quality %d, %u / %u: %s\n", quality, num, den,
+            drifted ? "a period of input did not make exactly den * 4 outputs" : "output does not repeat with the input" );
+        failures++;
+    }
+}
+
+int main(void)
+{
+    int quality;
+
+    resampler_init();
+
+    for (quality = RESAMPLER_QUALITY_MIN; quality <= RESAMPLER_QUALITY_MAX; ++quality)
+    {
+        check( quality, 147, 160 );
+        check( quality, 160, 147 );
+        check( quality, 441, 80 );
+        check( quality, 320, 147 );
+        check( quality, 48, 441 );
+    }
+
+    printf( failures ? "FAILED\n" : "passed\n" );
+    return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,130 @@
+// A k54 resampler copied with resampler_dup() or resampler_dup_inplace(),
+// or saved and loaded into another instance, must continue sample for
+// sample like the original, whatever its quality and rate; a truncated or
+// foreign state must be refused.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../k54/resampler.h"
+
+enum { INPUTS = 8000, CAPACITY = INPUTS * 2 };
+
+enum { RATE_PLAIN, RATE_DECIMATING, RATE_RATIONAL, RATE_RAMP, RATES };
+
+static const char * const rate_names[RATES] = { "1.0884", "13.7", "147 / 160", "ramp 0.9 to 1.3" };
+
+static float input[INPUTS * 2], expected[CAPACITY], output[CAPACITY];
+static int failures = 0;
+
+static void set_rate(void * r, int rate)
+{
+    switch ( rate )
+    {
+    case RATE_PLAIN: resampler_set_rate( r, 1.0884 ); break;
+    case RATE_DECIMATING: resampler_set_rate( r, 13.7 ); break;
+    case RATE_RATIONAL: resampler_set_rate_rational( r, 147, 160 ); break;
+    case RATE_RAMP: resampler_set_rate_ramp( r, 0.9, 1.3, 12000 ); break;
+    }
+}
+
+// feeds all of in and returns the samples made
+static int run(void * r, const float * in, float * out)
+{
+    size_t in_done = 0, out_done = 0;
+    for (;;)
+    {
+        size_t in_used, out_made;
+        resampler_process_float( r, in + in_done, INPUTS - in_done, &in_used, out + out_done, CAPACITY - out_done, &out_made );
+        in_done += in_used;
+        out_done += out_made;
+        if ( !in_used && !out_made ) break;
+    }
+    return (int)out_done;
+}
+
+static void compare(const char * how, int quality, int rate, void * r, int count)
+{
+    int made = run( r, input + INPUTS, output );
+    if ( made != count || memcmp( output, expected, count * sizeof(float) ) )
+    {
+        printf( "%s, quality %d, rate %s: continues differently\n", how, quality, rate_names[rate] );
+        failures++;
+    }
+}
+
+static void check(int quality, int rate)
+{
+    void * r = resampler_create();
+    void * dup, * dup_target, * load_target;
+    size_t size;
+    unsigned char * state;
+    int count;
+
+    resampler_set_quality( r, quality );
+    set_rate( r, rate );
+    run( r, input, output );
+
+    // targets with other settings and ring sizes than the original
+    dup_target = resampler_create_ex( 1000 );
+    resampler_set_quality( dup_target, quality == RESAMPLER_QUALITY_SINC ? RESAMPLER_QUALITY_BLEP : RESAMPLER_QUALITY_SINC );
+    resampler_set_rate( dup_target, rate == RATE_DECIMATING ? 0.7 : 9.0 );
+    load_target = resampler_create_ex( 1000 );
+    resampler_set_rate( load_target, rate == RATE_DECIMATING ? 0.7 : 9.0 );
+
+    dup = resampler_dup( r );
+    resampler_dup_inplace( dup_target, r );
+
+    size = resampler_get_state_size( r );
+    state = ( unsigned char * ) malloc( size );
+    if ( resampler_save_state( r, state, size ) != size || resampler_save_state( r, state, size - 1 ) )
+    {
+        printf( "quality %d, rate %s: save did not fill exactly the reported size\n", quality, rate_names[rate] );
+        failures++;
+    }
+    if ( !resampler_load_state( load_target, state, size ) )
+    {
+        printf( "quality %d, rate %s: load refused a saved state\n", quality, rate_names[rate] );
+        failures++;
+    }
+    if ( resampler_load_state( load_target, state, size - 1 ) )
+    {
+        printf( "quality %d, rate %s: load took a truncated state\n", quality, rate_names[rate] );
+        failures++;
+    }
+    state[0] ^= 0xff;
+    if ( resampler_load_state( load_target, state, size ) )
+    {
+        printf( "quality %d, rate %s: load took a state with a bad header\n", quality, rate_names[rate] );
+        failures++;
+    }
+    free( state );
+
+    count = run( r, input + INPUTS, expected );
+    compare( "dup", quality, rate, dup, count );
+    compare( "dup_inplace", quality, rate, dup_target, count );
+    compare( "load_state", quality, rate, load_target, count );
+
+    resampler_delete( r );
+    resampler_delete( dup );
+    resampler_delete( dup_target );
+    resampler_delete( load_target );
+}
+
+int main(void)
+{
+    int i, quality, rate;
+
+    resampler_init();
+    for (i = 0; i < INPUTS * 2; ++i)
+        input[i] = 0.5f * sinf( i * 0.013f ) + 0.25f * sinf( i * 0.41f );
+
+    for (quality = RESAMPLER_QUALITY_MIN; quality <= RESAMPLER_QUALITY_MAX; ++quality)
+        for (rate = 0; rate < RATES; ++rate)
+            check( quality, rate );
+
+    printf( failures ? "FAILED\n" : "passed\n" );
+    return failures ? EXIT_FAILURE : 0;
+}
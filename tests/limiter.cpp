@@ -0,0 +1,91 @@
+// limiter::process_block must produce exactly what process_sample does on
+// each sample in turn, for any split of the input into blocks, in place,
+// and when blocks and single samples are interleaved
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../limiter.h"
+
+using namespace monkee_limiter;
+
+enum { samples = 100000 };
+
+static float input[samples], expected[samples], output[samples];
+static int failures = 0;
+
+static void fill_input()
+{
+	// long quiet stretches where the envelope settles and the bypass runs,
+	// bursts the lookahead has to catch, silence, and single clipped
+	// samples landing at every block offset
+	for (int i = 0; i < samples; ++i)
+	{
+		float s = 0.5f * sinf(i * 0.013f) + 0.1f * sinf(i * 0.77f);
+		if (i >= 20000 && i < 40000 && (i / 1500) % 3 == 1) s *= 3.0f;
+		if (i >= 70000 && i < 75000) s = 0.0f;
+		input[i] = s;
+	}
+	for (int i = 80255; i < samples; i += 2049)
+		input[i] = -4.0f;
+}
+
+static void report(const char * how, int chunk)
+{
+	for (int i = 0; i < samples; ++i)
+	{
+		if (memcmp(&output[i], &expected[i], sizeof(float)))
+		{
+			printf("%s, chunk %d: sample %d is %.9g, expected %.9g\n", how, chunk, i, output[i], expected[i]);
+			failures++;
+			return;
+		}
+	}
+}
+
+int main()
+{
+	static const int chunks[] = { 1, 3, 17, 255, 256, 257, 1000, 4096 };
+
+	fill_input();
+	{
+		limiter reference;
+		for (int i = 0; i < samples; ++i)
+			expected[i] = reference.process_sample(input[i]);
+	}
+
+	for (unsigned c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c)
+	{
+		int chunk = chunks[c];
+
+		limiter block;
+		for (int i = 0; i < samples; i += chunk)
+			block.process_block(input + i, output + i, i + chunk < samples ? chunk : samples - i);
+		report("block", chunk);
+
+		limiter in_place;
+		memcpy(output, input, sizeof(output));
+		for (int i = 0; i < samples; i += chunk)
+			in_place.process_block(output + i, output + i, i + chunk < samples ? chunk : samples - i);
+		report("in place", chunk);
+
+		// a block, then a few single samples, so blocks start at every offset
+		limiter mixed;
+		int i = 0, singles = 0;
+		while (i < samples)
+		{
+			int count = i + chunk < samples ? chunk : samples - i;
+			mixed.process_block(input + i, output + i, count);
+			i += count;
+			singles = singles % 5 + 1;
+			for (int j = 0; j < singles && i < samples; ++j, ++i)
+				output[i] = mixed.process_sample(input[i]);
+		}
+		report("mixed", chunk);
+	}
+
+	printf(failures ? "FAILED\n" : "passed\n");
+	return failures ? EXIT_FAILURE : 0;
+}